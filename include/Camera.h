@@ -5,6 +5,10 @@
 #include <linux/videodev2.h>
 
 namespace vid {
+	class TraceRecorder;			// see CaptureTrace.h
+	class Executor;				// see Executor.h
+	class FrameAwaitable;
+
 	class Camera {
 	public:
 		// Simulation of a scoped enum which, contrary to normal scoped enums, can be implicitly converted to integral types.
@@ -42,7 +46,10 @@ namespace vid {
 				munmap_failed = -29,
 				device_mmap_unsupported = -30,
 				already_closed = -31,
-				file_close_failed = -32
+				file_close_failed = -32,
+				trace_write_failed = -33,
+				// NOTE: -34 and -35 are taken by ReplayCamera::Error.
+				stale_frame_lease = -36
 			};
 
 		private: ErrorValue value;
@@ -71,12 +78,22 @@ namespace vid {
 		uint32_t queuedFramesCount;
 		bool initialized = false;
 
+		// Bookkeeping for nextFrame() and FrameLease, see Executor.h. Changed through std::atomic_ref because leases get released from any worker thread.
+		uint32_t leasedFramesCount = 0;
+		uint32_t streamGeneration = 0;			// incremented by stop(), leases from an older generation don't get requeued
+		FrameAwaitable* parkedFrameAwaitable = nullptr;	// the nextFrame() call that waits for a lease to be released, only valid while parkedTicket isn't 0
+		uint32_t parkedTicket = 0;			// identifies the current parking, 0 if nothing is parked
+		uint32_t lastParkTicket = 0;
+
 		struct v4l2_buffer bufferData;
 
 		struct BufferLocation { void* start; size_t size; }* frameLocations;
 
 		struct v4l2_streamparm streamingParameters;
 
+		// If this is set, every frame that dequeueFrame() dequeues gets written into the trace. Not owned by the camera.
+		TraceRecorder* traceRecorder = nullptr;
+
 		explicit Camera(const char* deviceName) noexcept;				// NOTE: Explicit keyword prevents this from being used as a converting constructor.
 												// Without this, one could pass "/dev/video0" into a Camera parameter, which doesn't look good in my opinion.
 		Camera& operator=(Camera&& other) noexcept;
@@ -167,8 +184,24 @@ namespace vid {
 
 		// Dequeue the frame that was finished the earliest. Sets bufferData.index to the index of the newly dequeued frame.
 		// If called before start() or called when no frames are queued, returns Error::dequeue_frame_impossible.
+		// If traceRecorder is set, the frame gets recorded. If that fails, returns Error::trace_write_failed, the frame is still dequeued in that case.
 		Error dequeueFrame();
 
+		// Reads queuedFramesCount atomically. Use this instead of reading the member directly while leases are out.
+		uint32_t getQueuedFramesCount() const noexcept;
+
+		// Queue the frame at index. Doesn't touch bufferData, so unlike queueFrame(), this can be called from another thread than the one dequeueing,
+		// which is what FrameLease does. Don't mix this with queueFrame() on the same camera, queueFrame() expects to own the order in which buffers get queued.
+		Error queueFrame(uint32_t index);
+
+		// Dequeue a finished frame into buffer without waiting and without touching bufferData. Returns Error::dequeue_frame_impossible if no frames are
+		// queued or none of them are finished yet. If traceRecorder is set, the frame gets recorded, same as in dequeueFrame().
+		Error tryDequeueFrame(v4l2_buffer& buffer);
+
+		// For use in coroutines: co_await camera.nextFrame(executor) suspends until a frame is finished and resumes with a FrameLease, without blocking a thread.
+		// Requires frames to have been queued with queueFrame(uint32_t) or queueAllFrames(). See Executor.h. All leases have to be released before stop() and free().
+		FrameAwaitable nextFrame(Executor& executor);
+
 		// Queue all frames. bufferData.index equals 0 after function returns.
 		Error queueAllFrames();
 
@@ -181,6 +214,7 @@ namespace vid {
 		Error shootFrame();
 
 		// Stop streaming. This function is the counterpart to start(). All frames that haven't been dequeued yet are lost.
+		// Outstanding FrameLeases become stale and a coroutine waiting in nextFrame() gets resumed with an error.
 		// stop() can be called before calling start(), it doesn't do anything and doesn't return an error. It does however cause all queued frames to be lost.
 		Error stop();
 
@@ -0,0 +1,179 @@
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include <linux/videodev2.h>
+
+namespace vid {
+	// Trace file layout: TraceHeader, then one record per frame. Every record is a TraceRecord followed by the frame data, padded so that
+	// the next record starts at a multiple of traceAlignment. TraceRecord is traceAlignment bytes big, so frame data is aligned too.
+
+	static constexpr size_t traceAlignment = 64;
+
+	// NOTE: Only fixed width fields, so that traces recorded on a 32 bit Pi OS read the same on a 64 bit machine. v4l2_format can't be stored as is,
+	// its union contains pointers, which moves fmt to a different offset depending on the architecture.
+	struct TraceHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t bufferCount;				// bufferMetadata.count of the camera that recorded the trace
+		uint32_t reserved;
+		uint64_t frameCount;				// gets filled in when the recorder closes, 0 means the recording didn't finish properly
+
+		// the camera's format.fmt.pix
+		uint32_t width;
+		uint32_t height;
+		uint32_t pixelFormat;
+		uint32_t field;
+		uint32_t bytesPerLine;
+		uint32_t sizeImage;
+	};
+	static_assert(sizeof(TraceHeader) == 48, "TraceHeader is part of the file format, its layout can't depend on the architecture");
+
+	struct alignas(traceAlignment) TraceRecord {
+		int64_t timestampSeconds;
+		int64_t timestampMicroseconds;
+		uint32_t sequence;
+		uint32_t flags;
+		uint32_t bytesused;
+		uint32_t field;
+		uint32_t index;
+		uint32_t recordSize;				// size of this record including frame data and padding, distance to the next record
+	};
+
+	// Writes every frame the camera dequeues into a trace file. Hook it up by setting Camera::traceRecorder after opening it,
+	// Camera::dequeueFrame() calls record() after every successful dequeue.
+	class TraceRecorder {
+	public:
+		struct Error {
+			enum ErrorValue {
+				none = 0,
+				not_closed = -1,
+				file_open_failed = -2,
+				write_failed = -3,
+				already_closed = -4,
+				file_close_failed = -5
+			};
+
+		private: ErrorValue value;
+		public:
+			Error(ErrorValue value) noexcept;
+			operator int() const noexcept;
+		};
+
+		int fd = -1;
+		TraceHeader header;
+
+		TraceRecorder() noexcept = default;
+
+		TraceRecorder(const TraceRecorder& other) = delete;			// a copy would close fd a second time in its destructor
+		TraceRecorder& operator=(const TraceRecorder& other) = delete;
+
+		// Creates (or truncates) the trace file and writes the header. format and bufferCount should come from the camera after init().
+		Error open(const char* path, const v4l2_format& format, uint32_t bufferCount);
+
+		// Appends a record with buffer's metadata and buffer.bytesused bytes of data.
+		Error record(const v4l2_buffer& buffer, const void* data);
+
+		// Writes the final frame count into the header and closes the file.
+		Error close();
+
+		~TraceRecorder();			// calls close()
+	};
+
+	// Serves a recorded trace through the same interface that Camera has, so anything that is written against Camera's members and functions
+	// (as a template, for example) can run on a trace instead. The trace gets mmapped and frameLocations point straight into the mapping, so
+	// dequeueing doesn't copy anything. In real time mode, dequeueFrame() waits until the frame's original (relative) timestamp, otherwise
+	// frames come out as fast as they are asked for.
+	class ReplayCamera {
+	public:
+		// NOTE: Values that also exist in Camera::Error have the same numbers, so logs read the same for both.
+		struct Error {
+			enum ErrorValue {
+				none = 0,
+				not_closed = -1,
+				status_info_unavailable = -2,
+				file_open_failed = -4,
+				not_freed = -10,
+				mmap_failed = -19,
+				device_queue_buffer_failed = -23,
+				dequeue_frame_impossible = -24,
+				already_freed = -28,
+				munmap_failed = -29,
+				already_closed = -31,
+				file_close_failed = -32,
+				trace_invalid = -34,
+				end_of_trace = -35
+			};
+
+		private: ErrorValue value;
+		public:
+			Error(ErrorValue value) noexcept;
+			operator int() const noexcept;
+		};
+
+		const char* tracePath;
+		int fd = -1;
+
+		bool realTime = true;				// wait for the original frame timing, otherwise replay as fast as possible
+		bool loop = false;				// start over at the end of the trace instead of returning Error::end_of_trace
+		bool preload = false;				// fault the whole trace into memory in init(), so fast replays measure processing and not the SD card
+
+		struct v4l2_format format;
+		struct v4l2_requestbuffers bufferMetadata;
+		uint32_t lastBufferIndex;
+		uint32_t queuedFramesCount;
+		bool initialized = false;
+		bool streaming = false;
+
+		struct v4l2_buffer bufferData;
+
+		struct BufferLocation { void* start; size_t size; } frameLocations[VIDEO_MAX_FRAME];
+
+		uint8_t* mapping;
+		size_t mappingSize;
+		size_t nextRecordOffset;
+		uint64_t replayedFrameCount;
+
+		uint32_t queuedIndices[VIDEO_MAX_FRAME];	// ring of queued buffer indices, oldest first, like the driver's queue
+		uint32_t queueHead;
+
+		timespec replayStart;				// CLOCK_MONOTONIC time that the first frame of the current pass got served at
+		int64_t firstTimestamp;				// microseconds
+
+		explicit ReplayCamera(const char* tracePath) noexcept;
+
+		ReplayCamera(const ReplayCamera& other) = delete;
+		ReplayCamera& operator=(const ReplayCamera& other) = delete;
+
+		// opens the trace file
+		Error open();
+
+		// Maps the trace and fills format and bufferMetadata with the values of the recorded camera.
+		Error init();
+
+		Error start();
+
+		bool isFrameCorrupted() const noexcept;
+
+		// Queue the frame at bufferData.index. Increments bufferData.index.
+		Error queueFrame();
+
+		// Dequeues the oldest queued frame and fills it with the next record of the trace. Sets bufferData to the record's metadata.
+		// Returns Error::dequeue_frame_impossible if nothing is queued or the stream isn't started, Error::end_of_trace at the end of the trace (unless loop is set).
+		Error dequeueFrame();
+
+		Error queueAllFrames();
+		Error dequeueAllFrames();
+		Error shootFrame();
+
+		Error stop();
+
+		// unmaps the trace
+		Error free();
+
+		// Closes the trace file. Calls free().
+		Error close();
+
+		~ReplayCamera();			// calls close()
+	};
+}
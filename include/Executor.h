@@ -0,0 +1,181 @@
+#include <cstddef>
+#include <cstdint>
+#include <coroutine>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sys/time.h>
+
+#include <linux/videodev2.h>
+
+namespace vid {
+	class Camera;
+
+	// Small coroutine executor. One thread (the one that calls run()) waits on epoll for file descriptors that coroutines are waiting on,
+	// and a handful of worker threads resume coroutines that are ready to continue. There's no thread per camera: a camera coroutine that
+	// waits for a frame is just an entry in the epoll set.
+	//
+	// Usage:
+	// 	Task capture(Camera& camera, Executor& executor) {
+	// 		co_await executor.resumeOnWorker();
+	// 		while (true) {
+	// 			FrameLease frame = co_await camera.nextFrame(executor);
+	// 			if (!frame) { break; }			// only happens on real errors or after camera.stop(), waiting for buffers is handled inside
+	// 			...process frame.data...
+	// 		}						// frame gets requeued when the lease goes out of scope
+	// 	}
+	// Stages can hop onto another worker with co_await executor.resumeOnWorker(), which is how consecutive stages end up running on different cores.
+	class Executor {
+	public:
+		struct Error {
+			enum ErrorValue {
+				none = 0,
+				not_freed = -1,
+				invalid_worker_count = -2,
+				epoll_create_failed = -3,
+				eventfd_create_failed = -4,
+				watch_failed = -5,
+				epoll_wait_failed = -6,
+				already_freed = -7
+			};
+
+		private: ErrorValue value;
+		public:
+			Error(ErrorValue value) noexcept;
+			operator int() const noexcept;
+		};
+
+		// Something that waits for a file descriptor to become readable. ready() gets called on the thread that runs run(), so it must not wait on anything
+		// but schedule(). Usually it does a non-blocking read and then schedules the coroutine that's waiting, or calls watch() again if there was nothing to read after all.
+		// NOTE: schedule() does block while the ready queue is full. That stalls the I/O thread (and every other fd) until a worker takes a coroutine off
+		// the queue. Workers never wait for the I/O thread, so it can't deadlock as long as there are fewer coroutines than readyQueueCapacity.
+		struct Watcher {
+			void (*ready)(Watcher& watcher) noexcept;
+		};
+
+		static constexpr uint32_t maxWorkerCount = 4;
+		static constexpr uint32_t readyQueueCapacity = 256;
+
+		bool initialized = false;
+
+		int epollFd = -1;
+		int wakeFd = -1;				// eventfd that stop() uses to wake run() up
+
+		uint32_t workerCount;
+		std::thread workers[maxWorkerCount];
+
+		// Fixed size ring of coroutines that are ready to be resumed, so that scheduling never allocates.
+		std::mutex mutex;
+		std::condition_variable readyCondition;
+		std::condition_variable spaceCondition;
+		std::coroutine_handle<> readyQueue[readyQueueCapacity];
+		uint32_t readyHead;
+		uint32_t readyCount;
+		bool stopping;
+
+		// Creates the epoll instance and starts workerCount worker threads.
+		Error init(uint32_t workerCount = maxWorkerCount);
+
+		// Queues handle to be resumed on one of the worker threads. Blocks if the ready queue is full.
+		void schedule(std::coroutine_handle<> handle);
+
+		// Calls watcher.ready() once fd becomes readable (or reports an error). Only one watcher can wait on the same fd at a time.
+		Error watch(int fd, Watcher& watcher);
+
+		// Waits for watched file descriptors and calls their watchers. Blocks until stop() gets called.
+		Error run();
+
+		// Makes run() return and the workers exit once the ready queue is empty. Can be called from any thread, including from inside a coroutine.
+		void stop();
+
+		// Stops (if that hasn't happened already), joins the workers and closes the epoll instance.
+		Error free();
+
+		~Executor();			// calls free()
+
+		struct WorkerAwaitable {
+			Executor& executor;
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> handle) { executor.schedule(handle); }
+			void await_resume() const noexcept { }
+		};
+
+		// co_await this to continue on a worker thread.
+		WorkerAwaitable resumeOnWorker() noexcept { return { *this }; }
+	};
+
+	// Fire-and-forget coroutine. Starts running right away on the thread that calls it, and cleans up after itself when it finishes.
+	struct Task {
+		struct promise_type {
+			Task get_return_object() noexcept { return { }; }
+			std::suspend_never initial_suspend() noexcept { return { }; }
+			std::suspend_never final_suspend() noexcept { return { }; }
+			void return_void() noexcept { }
+			void unhandled_exception() noexcept { std::terminate(); }
+		};
+	};
+
+	// A dequeued frame. The buffer belongs to whoever holds the lease and gets queued back into the camera when the lease is destroyed (or release() gets called).
+	// Leases can be moved to other coroutines, which is how a frame gets handed down a pipeline.
+	// NOTE: Release every lease before calling Camera::stop() or Camera::free(). Leases that are released afterwards don't touch the device anymore
+	// (they return Camera::Error::stale_frame_lease), but the camera object itself still has to be alive when that happens.
+	class FrameLease {
+	public:
+		Camera* camera = nullptr;
+		int error;					// Camera::Error value, Camera::Error::none if this holds a frame
+		uint32_t generation;				// Camera::streamGeneration at the time of the dequeue
+		uint32_t index;
+		void* data;
+		uint32_t bytesused;
+		uint32_t sequence;
+		uint32_t flags;
+		timeval timestamp;
+
+		FrameLease() noexcept;
+		FrameLease(FrameLease&& other) noexcept;
+		FrameLease& operator=(FrameLease&& other) noexcept;
+
+		FrameLease(const FrameLease& other) = delete;
+		FrameLease& operator=(const FrameLease& other) = delete;
+
+		// true if this holds a frame
+		explicit operator bool() const noexcept;
+
+		// Queues the frame back into the camera and wakes the coroutine that waits in nextFrame() if it was waiting for a free buffer.
+		// Returns the result of Camera::queueFrame(uint32_t), Camera::Error::stale_frame_lease if the camera got stopped in the meantime,
+		// or Camera::Error::none if there is nothing to release.
+		int release() noexcept;
+
+		~FrameLease();			// calls release()
+	};
+
+	// Returned by Camera::nextFrame(). Suspends until a frame is finished, then dequeues it and resumes with a FrameLease. If there's a frame ready already,
+	// it doesn't suspend at all. If every buffer is leased out (downstream stages are still busy), it waits until a lease gets released.
+	// Resumes with an error lease on device errors, after Camera::stop(), or right away if nothing is queued or leased (nothing could ever wake it up).
+	// NOTE: Only one coroutine can wait in nextFrame() on the same camera at a time.
+	class FrameAwaitable : public Executor::Watcher {
+	public:
+		Camera& camera;
+		Executor& executor;
+		FrameLease result;
+
+		FrameAwaitable(Camera& camera, Executor& executor) noexcept;
+
+		bool await_ready() noexcept;
+		void await_suspend(std::coroutine_handle<> handle) noexcept;
+		FrameLease await_resume() noexcept;
+
+		// Continues the awaitable that is parked on camera waiting for a free buffer, if there is one. Called by FrameLease::release() and Camera::stop().
+		static void wakeParked(Camera& camera) noexcept;
+
+	private:
+		std::coroutine_handle<> handle;
+		uint32_t generation;
+
+		bool tryDequeue() noexcept;
+		void advance() noexcept;
+		bool park() noexcept;
+		static void onReadable(Executor::Watcher& watcher) noexcept;
+	};
+}
@@ -0,0 +1,102 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/videodev2.h>
+
+namespace vid {
+	// Owns all the memory that the frame pipeline needs, in one single mapping that gets allocated (and faulted in) once in init().
+	// Usage: plan() every buffer the pipeline is going to need (planFormat() does the usual ones based on the negotiated camera format),
+	// reserve some per-frame scratch space, then call init(). After that, nothing in the pipeline allocates anymore:
+	// planned buffers are fetched with get() and temporary buffers come from allocateScratch(), which is a bump allocator that gets reset every frame.
+	class FrameArena {
+	public:
+		struct Error {
+			enum ErrorValue {
+				none = 0,
+				not_freed = -1,
+				too_many_buffers = -2,
+				already_initialized = -3,
+				budget_exceeded = -4,
+				format_unsupported = -5,
+				mmap_failed = -6,
+				already_freed = -7,
+				munmap_failed = -8
+			};
+
+		private: ErrorValue value;
+		public:
+			Error(ErrorValue value) noexcept;
+			operator int() const noexcept;
+		};
+
+		static constexpr uint32_t maxBufferCount = 64;
+		static constexpr size_t alignment = 64;			// cache line, also plenty for any SIMD loads
+
+		struct Buffer { const char* name; size_t offset; size_t size; };
+
+		// Handles of the buffers that planFormat() plans.
+		struct FormatLayout {
+			uint32_t width;
+			uint32_t height;
+			uint32_t currentLuma;				// width * height bytes
+			uint32_t previousLuma;				// width * height bytes, for frame differencing
+			uint32_t differenceMap;				// width * height bytes
+			uint32_t conversionScratch;			// format.fmt.pix.sizeimage bytes, for anything that has to convert a whole frame
+			uint32_t preRoll;				// preRollFrameCount * format.fmt.pix.sizeimage bytes, ring of frames from before an event
+			uint32_t preRollFrameCount;
+			size_t frameSize;				// format.fmt.pix.sizeimage
+		};
+
+		bool initialized = false;
+
+		Buffer buffers[maxBufferCount];
+		uint32_t bufferCount = 0;
+		size_t plannedSize = 0;				// sum of all planned buffers, including alignment padding
+		size_t scratchSize = 0;
+
+		uint8_t* memory;
+		size_t memorySize;
+
+		size_t scratchUsed;
+		size_t peakScratchUsed;
+		uint64_t failedScratchAllocations;		// Should stay 0. If it doesn't, reserve more scratch space.
+
+		FrameArena() noexcept = default;
+
+		FrameArena(const FrameArena& other) = delete;			// a copy would unmap the arena a second time in its destructor
+		FrameArena& operator=(const FrameArena& other) = delete;
+
+		// Plans a buffer of size bytes and sets handle to something that can be passed to get() after init(). Needs to be called before init().
+		Error plan(const char* name, size_t size, uint32_t& handle);
+
+		// Plans the standard pipeline buffers for the negotiated camera format (use Camera::format after Camera::init()) and fills layout with their handles.
+		Error planFormat(const v4l2_format& format, uint32_t preRollFrameCount, FormatLayout& layout);
+
+		// Sets the size of the per-frame scratch region. Needs to be called before init().
+		Error reserveScratch(size_t size);
+
+		// Returns the amount of memory init() is going to allocate.
+		size_t requiredSize() const noexcept;
+
+		// Allocates the arena. Fails with Error::budget_exceeded if requiredSize() is bigger than budget, a budget of 0 means there is no limit.
+		// All of the memory is faulted in here and locked into RAM if the process is allowed to, so the hot path doesn't even take page faults.
+		Error init(size_t budget = 0);
+
+		// Returns the planned buffer that belongs to handle.
+		void* get(uint32_t handle) const noexcept;
+
+		// Returns size bytes (aligned to alignment) from the scratch region, or nullptr if the scratch region is exhausted.
+		void* allocateScratch(size_t size) noexcept;
+
+		// Releases everything allocateScratch() handed out. Call this once per frame.
+		void resetScratch() noexcept;
+
+		// Returns the peak amount of memory that has actually been in use: all planned buffers plus the highest scratch usage so far.
+		size_t peakUsage() const noexcept;
+
+		// Unmaps the arena. Planned buffers stay planned, so init() can be called again.
+		Error free();
+
+		~FrameArena();			// calls free()
+	};
+}
@@ -0,0 +1,90 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/videodev2.h>
+
+namespace vid {
+	// Luma statistics of a frame, gathered in one pass over the dequeued buffer: a 256 bin histogram, mean and variance per tile, and the amount
+	// of clipped pixels. From those, it estimates the sensor noise (from the flattest tiles) to suggest a threshold for frame differencing,
+	// and flags under- and overexposure.
+	//
+	// The histogram is counted into 4 sub-histograms (neighbouring pixels go into different ones), because neighbouring pixels often have the same
+	// value and incrementing the same counter back to back stalls on the store. Tile sums and sums of squares are SIMD.
+	// compute() does the whole frame. Stages that already walk the frame row by row can call beginFrame(), processRow() and finishFrame() themselves
+	// instead, so the rows are still in cache.
+	class FrameStatistics {
+	public:
+		struct Error {
+			enum ErrorValue {
+				none = 0,
+				not_freed = -1,
+				format_unsupported = -2,
+				invalid_tile_size = -3,
+				frame_too_large = -4,
+				already_freed = -5
+			};
+
+		private: ErrorValue value;
+		public:
+			Error(ErrorValue value) noexcept;
+			operator int() const noexcept;
+		};
+
+		enum class Exposure { normal, underexposed, overexposed };
+
+		static constexpr uint32_t maxWidth = 4096;
+		static constexpr uint32_t maxTileCount = 8192;
+		static constexpr uint32_t maxTileSize = 64;		// keeps the per-tile sums of squares inside 32 bits (64 * 64 * 255^2 < 2^32)
+
+		bool initialized = false;
+
+		uint32_t pixelFormat;
+		uint32_t width;
+		uint32_t height;
+		uint32_t tileSize;
+		uint32_t tilesPerRow;
+		uint32_t tilesPerColumn;
+
+		// settings, can be changed between frames
+		uint8_t lowClipLevel = 4;			// pixels <= this count as clipped to black
+		uint8_t highClipLevel = 251;			// pixels >= this count as clipped to white
+		float maxClippedFraction = 0.1;			// more clipped pixels than this (on one side) flags the exposure
+		float noisePercentile = 0.1;			// the noise estimate is the standard deviation of the unclipped tile at this percentile (flat tiles are mostly noise)
+		float noiseFactor = 3;				// suggestedThreshold = noiseFactor * noise estimate, clamped to [minThreshold, maxThreshold]
+		uint8_t minThreshold = 8;
+		uint8_t maxThreshold = 64;
+
+		// results of the last frame
+		uint32_t histogram[256];
+		uint64_t pixelCount;
+		float mean;
+		float variance;
+		uint64_t lowClippedCount;
+		uint64_t highClippedCount;
+		float tileMeans[maxTileCount];
+		float tileVariances[maxTileCount];
+		float noiseEstimate;
+		uint8_t suggestedThreshold;
+		Exposure exposure;
+
+		// Sets up the tile grid for the format (use Camera::format after Camera::init()). Supports GREY, YUYV, RGB24 and BGR24.
+		Error init(const v4l2_format& format, uint32_t tileSize = 32);
+
+		// Runs over the whole frame and fills in all results. bytesPerLine is format.fmt.pix.bytesperline.
+		void compute(const void* frame, uint32_t bytesPerLine) noexcept;
+
+		// The three steps of compute(), for stages that want to share the pass over the frame. processRow() has to be called for rows 0 to height - 1, in order.
+		void beginFrame() noexcept;
+		void processRow(const uint8_t* row, uint32_t y) noexcept;
+		void finishFrame() noexcept;
+
+		Error free();
+
+	private:
+		uint32_t subHistograms[4][256];
+		uint32_t tileSums[maxTileCount];
+		uint32_t tileSumSquares[maxTileCount];
+		float sortScratch[maxTileCount];
+		alignas(64) uint8_t lumaRow[maxWidth];
+	};
+}
@@ -0,0 +1,122 @@
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <barrier>
+#include <optional>
+#include <atomic>
+
+namespace vid {
+	// Turns a motion mask (the difference map, or a block mask, one byte per cell) into objects with bounding boxes, areas and centroids,
+	// and keeps the same ID for an object from one frame to the next.
+	//
+	// Labelling is connected-component labelling with union-find, split into horizontal bands, one band per thread:
+	// 	1. every thread labels its own band (parent links never leave the band, so no synchronization is needed)
+	// 	2. the seams between bands get merged (sequential, only touches one row per seam)
+	// 	3. every thread collects the stats of the objects in its band into its own table
+	// 	4. the calling thread merges those tables, filters out small objects and associates the result with the previous frame's objects
+	class MotionLabeller {
+	public:
+		struct Error {
+			enum ErrorValue {
+				none = 0,
+				not_freed = -1,
+				invalid_size = -2,
+				invalid_thread_count = -3,
+				object_limit_reached = -4,			// there were more objects than maxObjectCount, the rest got dropped
+				time_budget_exceeded = -5,			// results are valid, but labelling took longer than timeBudget
+				already_freed = -6
+			};
+
+		private: ErrorValue value;
+		public:
+			Error(ErrorValue value) noexcept;
+			operator int() const noexcept;
+		};
+
+		static constexpr uint32_t maxThreadCount = 8;
+		static constexpr uint32_t maxObjectCount = 256;
+		static constexpr uint32_t bandTableSize = 1024;		// hash table slots per band, power of two
+		static constexpr uint32_t mergeTableSize = maxThreadCount * bandTableSize;	// big enough for every band's table to be full without any components being shared
+
+		struct Object {
+			uint32_t id;
+			uint32_t area;				// amount of mask cells
+			uint32_t left, top, right, bottom;	// bounding box in mask cells, right and bottom are exclusive
+			float centroidX, centroidY;
+			uint32_t age;				// amount of consecutive frames this object has been tracked for, 0 for new objects
+		};
+
+		// Per-band stats of one component, keyed by the component's root.
+		struct ComponentStats {
+			uint32_t root;				// UINT32_MAX marks an empty slot
+			uint32_t area;
+			uint32_t left, top, right, bottom;
+			uint64_t sumX, sumY;
+		};
+
+		struct Band {
+			uint32_t top, bottom;
+			ComponentStats table[bandTableSize];
+			uint32_t usedSlots[bandTableSize];	// so that clearing and merging the table doesn't have to go through all of it
+			uint32_t usedCount;
+			uint32_t droppedCount;			// components that didn't fit into the table
+		};
+
+		bool initialized = false;
+
+		uint32_t width;
+		uint32_t height;
+		uint32_t threadCount;
+		uint32_t* parents;				// width * height union-find links, memory comes from the caller (see requiredSize())
+
+		// settings, can be changed between calls to label()
+		uint8_t maskThreshold = 1;			// mask values >= this count as motion, so a difference map can be passed in directly
+		uint32_t minArea = 16;				// smaller objects are dropped (insects, rain, noise)
+		float maxAssociationDistance = 32;		// max centroid movement (in mask cells) between frames for an object to keep its ID
+		uint32_t timeBudget = 4000;			// microseconds, 0 disables the check
+
+		Object objects[maxObjectCount];
+		uint32_t objectCount = 0;
+		Object previousObjects[maxObjectCount];
+		uint32_t previousObjectCount = 0;
+		uint32_t nextId = 1;
+		uint32_t lastDuration;				// microseconds that the last label() call took
+
+		Band bands[maxThreadCount];
+		ComponentStats mergeTable[mergeTableSize];
+		uint32_t mergeUsedSlots[mergeTableSize];
+
+		// Returns the amount of memory that init() needs for a mask of the given size. Best planned into the FrameArena.
+		static size_t requiredSize(uint32_t width, uint32_t height) noexcept;
+
+		// Starts threadCount - 1 worker threads, the thread that calls label() does the work of the last band itself.
+		// memory has to be at least requiredSize(width, height) bytes big and stay valid until free().
+		Error init(uint32_t width, uint32_t height, uint32_t threadCount, void* memory);
+
+		// Labels mask (stride is the distance between rows in bytes) and fills objects with the results.
+		Error label(const uint8_t* mask, size_t stride);
+
+		// Stops the worker threads.
+		Error free();
+
+		~MotionLabeller();			// calls free()
+
+	private:
+		struct SeamMerge { MotionLabeller* labeller; void operator()() noexcept; };
+
+		const uint8_t* mask;
+		size_t stride;
+		std::atomic<bool> stopping;
+		std::optional<std::barrier<>> startBarrier;
+		std::optional<std::barrier<SeamMerge>> seamBarrier;
+		std::optional<std::barrier<>> endBarrier;
+		std::thread workers[maxThreadCount - 1];
+
+		void labelBand(Band& band) noexcept;
+		void mergeSeams() noexcept;
+		void collectBand(Band& band) noexcept;
+		void work(uint32_t bandIndex) noexcept;
+		uint32_t mergeBands() noexcept;
+		void associate() noexcept;
+	};
+}
@@ -0,0 +1,120 @@
+#include <cstddef>
+#include <cstdint>
+#include <sys/time.h>
+
+namespace vid {
+	class Screen;
+
+	// Draws status text, zone outlines and motion boxes on top of a Screen. Everything that gets drawn in a frame is first collected as a list of
+	// primitives, then composite() draws them tile by tile, only touching the tiles that the primitives actually cover. Text is drawn from a glyph atlas
+	// that gets rasterized into horizontal spans once in init(), so drawing a glyph is just a couple of span fills in the framebuffer's native pixel format.
+	class Overlay {
+	public:
+		struct Error {
+			enum ErrorValue {
+				none = 0,
+				not_freed = -1,
+				screen_not_initialized = -2,
+				pixel_format_unsupported = -3,
+				screen_too_large = -4,
+				too_many_primitives = -5,
+				already_freed = -6
+			};
+
+		private: ErrorValue value;
+		public:
+			Error(ErrorValue value) noexcept;
+			operator int() const noexcept;
+		};
+
+		static constexpr uint32_t tileSize = 64;
+		static constexpr uint32_t maxTileCount = 64 * 40;		// enough for 4096x2160 with 64x64 tiles
+		static constexpr uint32_t maxPrimitiveCount = 128;
+		static constexpr uint32_t maxTextLength = 48;
+
+		static constexpr uint32_t glyphWidth = 5;
+		static constexpr uint32_t glyphHeight = 7;
+		static constexpr uint32_t glyphAdvance = glyphWidth + 1;	// one column of spacing between glyphs
+		static constexpr char firstGlyph = ' ';
+		static constexpr char lastGlyph = 'Z';
+		static constexpr uint32_t glyphCount = lastGlyph - firstGlyph + 1;
+		static constexpr uint32_t maxSpansPerGlyphRow = 3;		// a 5 pixel wide row can't have more than 3 separate runs
+
+		struct Span { uint16_t start; uint16_t length; };
+
+		// One rasterized row of a glyph. All scaled rows that come from the same font row share one of these.
+		struct GlyphRow { Span spans[maxSpansPerGlyphRow]; uint8_t spanCount; };
+
+		struct Primitive {
+			enum Type : uint8_t { fill, text } type;
+			int32_t left; int32_t top; int32_t right; int32_t bottom;		// bounds, right and bottom are exclusive, already clipped to the screen
+			int32_t x; int32_t y;							// unclipped origin, needed to place glyphs
+			uint32_t color;								// native pixel value
+			char characters[maxTextLength];
+			uint8_t length;
+		};
+
+		bool initialized = false;
+
+		// Microseconds added to the timestamp that addFrameInfo() gets before it's turned into a date. V4L2 buffer timestamps count from boot
+		// (V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC), so set this to CLOCK_REALTIME - CLOCK_MONOTONIC when passing those in. Leave it at 0 for gettimeofday() times.
+		int64_t timestampOffset = 0;
+
+		uint8_t* frame;
+		uint32_t width;
+		uint32_t height;
+		uint32_t bytesPerPixel;
+		size_t bytesPerLine;
+
+		// native pixel format, taken from the screen's fb_var_screeninfo
+		uint8_t redOffset, redLength, greenOffset, greenLength, blueOffset, blueLength, alphaOffset, alphaLength;
+
+		uint32_t textScale;
+		GlyphRow glyphAtlas[glyphCount][glyphHeight];
+
+		uint32_t tilesPerRow;
+		uint32_t tilesPerColumn;
+		uint64_t touchedTiles[maxTileCount / 64];
+		uint64_t previouslyTouchedTiles[maxTileCount / 64];
+
+		Primitive primitives[maxPrimitiveCount];
+		uint32_t primitiveCount;
+
+		// Binds the overlay to an initialized screen and rasterizes the glyph atlas. textScale is the size of one font pixel in screen pixels.
+		// The screen has to stay initialized for as long as the overlay is used.
+		Error init(const Screen& screen, uint32_t textScale = 2);
+
+		// converts an 8 bit per channel color into the screen's native pixel format
+		uint32_t color(uint8_t red, uint8_t green, uint8_t blue) const noexcept;
+
+		// Starts a new frame. Forgets all primitives and remembers which tiles were touched by the last frame, see wasTileTouched().
+		void beginFrame() noexcept;
+
+		// Adds a filled rectangle. Parts outside of the screen are clipped away.
+		Error addFilledRect(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t color);
+
+		// Adds the outline of a rectangle, drawn on the inside of the given bounds. Used for zone outlines and motion bounding boxes.
+		// Only the tiles the four edges go through get touched, not the whole area inside the box.
+		Error addBox(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t thickness, uint32_t color);
+
+		// Adds a line of text. Lower case letters are drawn as upper case, characters that aren't in the atlas are drawn as spaces.
+		// Text longer than maxTextLength gets cut off.
+		Error addText(int32_t x, int32_t y, const char* text, uint32_t color);
+
+		// Adds a "YYYY-MM-DD HH:MM:SS  FF.F FPS" line in local time. timestamp is meant to be something like Camera::bufferData.timestamp,
+		// which needs timestampOffset to be set to come out as the wall clock time.
+		Error addFrameInfo(int32_t x, int32_t y, const timeval& timestamp, float framesPerSecond, uint32_t color);
+
+		// Draws all primitives of the current frame into the screen, tile by tile.
+		void composite() const noexcept;
+
+		// Returns true if the current frame draws something into the given tile.
+		bool isTileTouched(uint32_t tileX, uint32_t tileY) const noexcept;
+		// Returns true if the previous frame drew something into the given tile. If such a tile isn't touched by the current frame as well,
+		// whatever is behind the overlay has to be redrawn there to get rid of the old overlay.
+		bool wasTileTouched(uint32_t tileX, uint32_t tileY) const noexcept;
+
+		// Unbinds the overlay from the screen. Doesn't touch the screen itself.
+		Error free();
+	};
+}
@@ -0,0 +1,141 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/videodev2.h>
+
+namespace vid {
+	class Camera;
+
+	// Stores recorded frames in a ring of fixed-size segment files which get preallocated once (fallocate) and then reused forever, so the SD card
+	// never sees a growing or freshly allocated file. Every frame and every event gets an entry in one of two memory-mapped, append-only index files.
+	// Entries are ordered by timestamp, which makes seeking and range queries a binary search over the mapped index, without reading any video data.
+	//
+	// Directory layout:
+	// 	segment_000.bin ... segment_NNN.bin		raw frame data, segmentSize bytes each
+	// 	frames.idx					one IndexEntry per frame
+	// 	events.idx					one IndexEntry per event (motion start/end, etc...)
+	class RecordingStore {
+	public:
+		struct Error {
+			enum ErrorValue {
+				none = 0,
+				not_closed = -1,
+				invalid_layout = -2,
+				segment_open_failed = -3,
+				segment_allocation_failed = -4,
+				index_open_failed = -5,
+				index_allocation_failed = -6,
+				mmap_failed = -7,
+				index_layout_mismatch = -8,
+				frame_too_large = -9,
+				timestamp_out_of_order = -10,
+				segment_write_failed = -11,
+				segment_read_failed = -12,
+				not_found = -13,
+				msync_failed = -14,
+				munmap_failed = -15,
+				already_closed = -16,
+				file_close_failed = -17
+			};
+
+		private: ErrorValue value;
+		public:
+			Error(ErrorValue value) noexcept;
+			operator int() const noexcept;
+		};
+
+		static constexpr uint32_t maxSegmentCount = 1024;
+
+		struct EntryType {
+			enum : uint32_t {
+				frame = 0,
+				motion_start = 1,
+				motion_end = 2,
+				user = 16				// first value that is free for use by the caller
+			};
+		};
+
+		// 32 bytes, so that an index page holds a whole number of entries
+		struct IndexEntry {
+			uint64_t timestamp;				// microseconds, see timestampOffset
+			uint64_t offset;				// byte offset of the frame data inside the segment
+			uint32_t size;					// size of the frame data, 0 for events
+			uint32_t segment;
+			uint32_t sequence;				// v4l2_buffer.sequence for frames
+			uint32_t type;					// EntryType
+		};
+
+		// Lives at the start of every index file. The index itself is a ring of capacity entries, entries [firstEntry, endEntry) are valid.
+		// Those two are logical (ever-increasing) positions, entry n lives at slot n % capacity.
+		struct IndexHeader {
+			uint32_t magic;
+			uint32_t version;
+			uint32_t segmentCount;
+			uint32_t writeSegment;				// only used in the frame index, stores the write position so that we can resume after a restart
+			uint64_t segmentSize;
+			uint64_t capacity;
+			uint64_t firstEntry;
+			uint64_t endEntry;
+			uint64_t writeOffset;
+			uint64_t reserved;
+		};
+
+		struct MappedIndex {
+			int fd = -1;
+			IndexHeader* header = nullptr;
+			IndexEntry* entries;
+			size_t mappingSize;
+		};
+
+		const char* directory;
+
+		uint32_t segmentCount;
+		uint64_t segmentSize;
+		uint64_t indexCapacity;
+		int segmentFds[maxSegmentCount];
+
+		MappedIndex frameIndex;
+		MappedIndex eventIndex;
+
+		// Added to every v4l2_buffer timestamp before it goes into the index. Camera timestamps are usually CLOCK_MONOTONIC, which restarts on every boot.
+		// Set this to (CLOCK_REALTIME - CLOCK_MONOTONIC) in microseconds after opening to get wall clock timestamps that stay ordered across restarts.
+		int64_t timestampOffset = 0;
+
+		explicit RecordingStore(const char* directory) noexcept;
+
+		RecordingStore(const RecordingStore& other) = delete;
+		RecordingStore& operator=(const RecordingStore& other) = delete;
+
+		// Opens the store in directory (which has to exist), creating and preallocating the segment and index files if they don't exist yet.
+		// If the store already exists, writing resumes where it stopped. Opening an existing store with a different layout fails with Error::index_layout_mismatch.
+		Error open(uint32_t segmentCount, uint64_t segmentSize, uint64_t indexCapacity);
+
+		// Writes the frame data and adds an index entry for it. If the frame doesn't fit into the rest of the current segment, writing continues at the
+		// start of the next segment in the ring, which drops all index entries that pointed into that segment.
+		// Timestamps have to be non-decreasing, otherwise this fails with Error::timestamp_out_of_order.
+		Error appendFrame(const v4l2_buffer& buffer, const void* data);
+		// Same as above, uses the frame that the camera most recently dequeued.
+		Error appendFrame(const Camera& camera);
+
+		// Adds an event entry which points at the most recently written frame (or at the current write position if there isn't one).
+		Error appendEvent(uint64_t timestamp, uint32_t type);
+
+		// Finds the first frame with a timestamp >= timestamp. Returns Error::not_found if there isn't one.
+		Error seek(uint64_t timestamp, IndexEntry& entry) const;
+
+		// Copies up to capacity events with begin <= timestamp < end into events, in order. count is set to the amount of copied events.
+		Error findEvents(uint64_t begin, uint64_t end, IndexEntry* events, size_t capacity, size_t& count) const;
+
+		// Reads the frame data of a frame entry into destination, which has to be at least entry.size bytes big.
+		// NOTE: If the segment got reused since the entry was looked up, this reads whatever is there now. Look entries up right before reading them.
+		Error readFrame(const IndexEntry& entry, void* destination) const;
+
+		// Flushes both indices to the storage device.
+		Error sync();
+
+		// Syncs, unmaps the indices and closes all files.
+		Error close();
+
+		~RecordingStore();			// calls close()
+	};
+}
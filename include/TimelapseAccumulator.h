@@ -0,0 +1,86 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/videodev2.h>
+
+namespace vid {
+	// Builds timelapse frames and event thumbnails on the fly from every dequeued frame, so nothing has to reread recorded video later.
+	// Every pushed frame gets box-filtered down by factor in a single pass (vertical sums are SIMD, the horizontal reduction works on the already
+	// summed rows and uses a fixed-point reciprocal instead of a division). The downscaled frame gets added to the timelapse accumulator, which turns
+	// into a timelapse frame every framesPerTimelapseFrame frames, and can be copied into the thumbnail strip of the current event.
+	//
+	// Output frames have the same pixel format as the input, just smaller. YUYV gets filtered in whole macropixels, so factor has to be even for YUYV.
+	class TimelapseAccumulator {
+	public:
+		struct Error {
+			enum ErrorValue {
+				none = 0,
+				not_freed = -1,
+				format_unsupported = -2,
+				invalid_factor = -3,
+				invalid_interval = -4,
+				thumbnail_strip_full = -5,
+				already_freed = -6
+			};
+
+		private: ErrorValue value;
+		public:
+			Error(ErrorValue value) noexcept;
+			operator int() const noexcept;
+		};
+
+		static constexpr uint32_t maxFactor = 64;
+		static constexpr uint32_t maxFramesPerTimelapseFrame = 1 << 24;	// keeps the 32 bit timelapse sums from overflowing, about 6 days at 30 FPS
+
+		bool initialized = false;
+
+		uint32_t channels;			// bytes per filtered unit: 3 for RGB24/BGR24, 1 for GREY, 4 for YUYV (one macropixel)
+		uint32_t factor;
+		uint32_t horizontalFactor;		// in units, factor / 2 for YUYV
+		uint32_t inputUnits;			// units per input row
+		uint32_t outputWidth;			// in pixels
+		uint32_t outputHeight;
+		size_t outputBytesPerLine;
+		size_t outputSize;			// size of one output frame in bytes
+
+		uint32_t framesPerTimelapseFrame;
+		uint32_t accumulatedFrameCount;
+		uint64_t timelapseFrameCount;		// amount of timelapse frames emitted so far
+		bool timelapseFrameReady;		// true right after the push() that completed a timelapse frame
+
+		uint32_t thumbnailCapacity;
+		uint32_t thumbnailCount;
+
+		uint32_t boxReciprocal;			// 2^16 / (factor * horizontalFactor), rounded
+		uint64_t timelapseReciprocal;		// 2^32 / framesPerTimelapseFrame, rounded
+
+		// all of these point into the memory passed to init()
+		uint32_t* timelapseSums;
+		uint16_t* columnSums;
+		uint8_t* current;			// the downscaled version of the most recently pushed frame
+		uint8_t* timelapseFrame;
+		uint8_t* thumbnails;
+
+		// Returns the amount of memory that init() needs, or 0 if the format or factor is unsupported. Best planned into the FrameArena.
+		static size_t requiredSize(const v4l2_format& format, uint32_t factor, uint32_t thumbnailCapacity) noexcept;
+
+		// format is the negotiated camera format (Camera::format after Camera::init()). memory has to be at least requiredSize() bytes big,
+		// aligned to at least 4 bytes, and has to stay valid until free().
+		Error init(const v4l2_format& format, uint32_t factor, uint32_t framesPerTimelapseFrame, uint32_t thumbnailCapacity, void* memory);
+
+		// Downscales frame and accumulates it. bytesPerLine is the stride of frame (format.fmt.pix.bytesperline).
+		// If this completes a timelapse frame, timelapseFrameReady is set and timelapseFrame holds the average of the last framesPerTimelapseFrame frames.
+		void push(const void* frame, uint32_t bytesPerLine) noexcept;
+
+		// Starts a new thumbnail strip.
+		void beginEvent() noexcept;
+
+		// Appends the downscaled version of the most recently pushed frame to the thumbnail strip.
+		Error captureThumbnail() noexcept;
+
+		// Returns thumbnail number index of the current strip.
+		const uint8_t* thumbnail(uint32_t index) const noexcept;
+
+		Error free();
+	};
+}
@@ -1,4 +1,6 @@
 #include "../include/Camera.h"
+#include "../include/CaptureTrace.h"
+#include "../include/Executor.h"
 
 #include <stdlib.h>			// TODO: Maybe check if all these headers are all necessary and what corresponds to what.
 #include <sys/stat.h>
@@ -13,6 +15,7 @@
 #include <cerrno>
 #include <sys/ioctl.h>
 #include <cstring>
+#include <atomic>
 
 #include <linux/videodev2.h>
 
@@ -81,6 +84,12 @@ Camera& Camera::operator=(Camera&& other) noexcept {
 	bufferData = other.bufferData;
 	frameLocations = other.frameLocations;
 	streamingParameters = other.streamingParameters;
+	traceRecorder = other.traceRecorder;
+	leasedFramesCount = other.leasedFramesCount;
+	streamGeneration = other.streamGeneration;
+	parkedFrameAwaitable = other.parkedFrameAwaitable;
+	parkedTicket = other.parkedTicket;
+	lastParkTicket = other.lastParkTicket;
 
 	other.initialized = false;
 	other.fd = -1;
@@ -188,6 +197,7 @@ Camera::Error Camera::init() {
 	bufferData.index = 0;			// We do this so that queueFrame has a good starting point.
 						// We also HAVE to change it because without this line, bufferData.index equals bufferMetadata.count + 1.
 	queuedFramesCount = 0;
+	leasedFramesCount = 0;
 	initialized = true;
 	return Error::none;
 
@@ -195,7 +205,7 @@ freeAndReturnError:
 	// try to free the mmaps that didn't fail
 	for (uint32_t i = 0; i < bufferData.index; i++) { munmap(frameLocations[i].start, frameLocations[i].size); }	// no need to handle error here
 
-	delete[] frameLocations;
+	::free(frameLocations);			// allocated with calloc, so it has to go back through free(), not delete[]
 
 freeDeviceBuffersAndReturnError:
 	bufferMetadata.count = 0;
@@ -271,9 +281,40 @@ Camera::Error Camera::dequeueFrame() {
 	if (pollStruct.revents & POLLERR) { return Error::dequeue_frame_impossible; }
 	if (interruptedIoctl(fd, VIDIOC_DQBUF, &bufferData) == -1) { return Error::device_dequeue_buffer_failed; }
 	queuedFramesCount--;
+	if (traceRecorder && traceRecorder->record(bufferData, frameLocations[bufferData.index].start) != TraceRecorder::Error::none) { return Error::trace_write_failed; }
 	return Error::none;
 }
 
+// NOTE: queueFrame(uint32_t) and tryDequeueFrame() get called from whichever worker thread a coroutine happens to be running on, so they change
+// queuedFramesCount through std::atomic_ref. The ioctls themselves are fine to call concurrently, the driver locks the queue.
+
+uint32_t Camera::getQueuedFramesCount() const noexcept { return std::atomic_ref<uint32_t>(const_cast<uint32_t&>(queuedFramesCount)).load(); }
+
+Camera::Error Camera::queueFrame(uint32_t index) {
+	v4l2_buffer buffer;
+	bzero(&buffer, sizeof(buffer));
+	buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buffer.memory = V4L2_MEMORY_MMAP;
+	buffer.index = index;
+	if (interruptedIoctl(fd, VIDIOC_QBUF, &buffer) == -1) { return Error::device_queue_buffer_failed; }
+	std::atomic_ref<uint32_t>(queuedFramesCount).fetch_add(1);
+	return Error::none;
+}
+
+Camera::Error Camera::tryDequeueFrame(v4l2_buffer& buffer) {
+	if (std::atomic_ref<uint32_t>(queuedFramesCount).load() == 0) { return Error::dequeue_frame_impossible; }
+	bzero(&buffer, sizeof(buffer));
+	buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buffer.memory = V4L2_MEMORY_MMAP;
+	// NOTE: fd is opened with O_NONBLOCK, so this fails with EAGAIN instead of waiting if nothing is finished yet.
+	if (interruptedIoctl(fd, VIDIOC_DQBUF, &buffer) == -1) { return errno == EAGAIN ? Error::dequeue_frame_impossible : Error::device_dequeue_buffer_failed; }
+	std::atomic_ref<uint32_t>(queuedFramesCount).fetch_sub(1);
+	if (traceRecorder && traceRecorder->record(buffer, frameLocations[buffer.index].start) != TraceRecorder::Error::none) { return Error::trace_write_failed; }
+	return Error::none;
+}
+
+FrameAwaitable Camera::nextFrame(Executor& executor) { return FrameAwaitable(*this, executor); }
+
 Camera::Error Camera::queueAllFrames() {
 	bufferData.index = 0;
 	Error err = queueFrame(); if (err != Error::none) { return err; }
@@ -297,7 +338,10 @@ Camera::Error Camera::shootFrame() {
 Camera::Error Camera::stop() {
 	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	if (interruptedIoctl(fd, VIDIOC_STREAMOFF, &type) == -1) { return Error::device_stop_failed; }
-	queuedFramesCount = 0;
+	std::atomic_ref<uint32_t>(queuedFramesCount).store(0);
+	std::atomic_ref<uint32_t>(leasedFramesCount).store(0);
+	std::atomic_ref<uint32_t>(streamGeneration).fetch_add(1);
+	FrameAwaitable::wakeParked(*this);
 	return Error::none;
 }
 
@@ -308,7 +352,8 @@ Camera::Error Camera::free() {
 	if (err != Error::none) { return err; }
 
 	for (uint32_t i = 0; i < bufferMetadata.count; i++) { if (munmap(frameLocations[i].start, frameLocations[i].size) == -1) { return Error::munmap_failed; } }
-	delete[] frameLocations;
+	::free(frameLocations);
+	initialized = false;
 
 	bufferMetadata.count = 0;
 	if (interruptedIoctl(fd, VIDIOC_REQBUFS, &bufferMetadata) == -1) { if (errno == EINVAL) { return Error::device_mmap_unsupported; } return Error::device_buffer_request_failed; }
@@ -324,7 +369,7 @@ Camera::Error Camera::close() {
 	// Plus, it might not even improve performance or make the slightest amount of difference because the driver probably checks if the buffers are freed.
 	// If they are, like we're doing right now, the driver probably skips unnecessary work.
 	Error err = free();
-	if (err != Error::none) { return err; }
+	if (err != Error::none && err != Error::already_freed) { return err; }		// already freed is fine, that's the usual free() then close() order
 
 	if (::close(fd) == -1) { fd = -1; return Error::file_close_failed; }
 	fd = -1;
@@ -0,0 +1,268 @@
+#include "../include/CaptureTrace.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <linux/videodev2.h>
+
+using namespace vid;
+
+static constexpr uint32_t traceMagic = 0x43525456;		// "VTRC"
+static constexpr uint32_t traceVersion = 2;
+
+static size_t alignUp(size_t size) noexcept { return (size + traceAlignment - 1) & ~(traceAlignment - 1); }
+
+static const size_t firstRecordOffset = alignUp(sizeof(TraceHeader));
+
+// Writes all of the iovecs, continuing after partial writes and signal interruptions.
+static bool writeAll(int fd, iovec* vectors, int count) {
+	while (count != 0) {
+		ssize_t written = writev(fd, vectors, count);
+		if (written == -1) { if (errno == EINTR) { continue; } return false; }
+		while (count != 0 && (size_t)written >= vectors->iov_len) { written -= vectors->iov_len; vectors++; count--; }
+		if (count != 0) { vectors->iov_base = (uint8_t*)vectors->iov_base + written; vectors->iov_len -= written; }
+	}
+	return true;
+}
+
+// TraceRecorder::Error
+
+TraceRecorder::Error::Error(TraceRecorder::Error::ErrorValue value) noexcept : value(value) { }
+
+TraceRecorder::Error::operator int() const noexcept { return value; }
+
+// TraceRecorder
+
+TraceRecorder::Error TraceRecorder::open(const char* path, const v4l2_format& format, uint32_t bufferCount) {
+	if (fd != -1) { return Error::not_closed; }
+	fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) { return Error::file_open_failed; }
+
+	bzero(&header, sizeof(header));
+	header.magic = traceMagic;
+	header.version = traceVersion;
+	header.bufferCount = bufferCount;
+	header.width = format.fmt.pix.width;
+	header.height = format.fmt.pix.height;
+	header.pixelFormat = format.fmt.pix.pixelformat;
+	header.field = format.fmt.pix.field;
+	header.bytesPerLine = format.fmt.pix.bytesperline;
+	header.sizeImage = format.fmt.pix.sizeimage;
+
+	static const uint8_t padding[traceAlignment] = { };
+	iovec vectors[2] = { { &header, sizeof(header) }, { (void*)padding, firstRecordOffset - sizeof(header) } };
+	if (!writeAll(fd, vectors, 2)) { return Error::write_failed; }
+	return Error::none;
+}
+
+TraceRecorder::Error TraceRecorder::record(const v4l2_buffer& buffer, const void* data) {
+	TraceRecord record;
+	bzero(&record, sizeof(record));
+	record.timestampSeconds = buffer.timestamp.tv_sec;
+	record.timestampMicroseconds = buffer.timestamp.tv_usec;
+	record.sequence = buffer.sequence;
+	record.flags = buffer.flags;
+	record.bytesused = buffer.bytesused;
+	record.field = buffer.field;
+	record.index = buffer.index;
+	record.recordSize = sizeof(TraceRecord) + alignUp(buffer.bytesused);
+
+	static const uint8_t padding[traceAlignment] = { };
+	iovec vectors[3] = { { &record, sizeof(record) }, { (void*)data, buffer.bytesused }, { (void*)padding, alignUp(buffer.bytesused) - buffer.bytesused } };
+	if (!writeAll(fd, vectors, 3)) { return Error::write_failed; }
+	header.frameCount++;
+	return Error::none;
+}
+
+TraceRecorder::Error TraceRecorder::close() {
+	if (fd == -1) { return Error::already_closed; }
+	Error err = Error::none;
+	if (pwrite(fd, &header.frameCount, sizeof(header.frameCount), offsetof(TraceHeader, frameCount)) != sizeof(header.frameCount)) { err = Error::write_failed; }
+	if (::close(fd) == -1 && err == Error::none) { err = Error::file_close_failed; }
+	fd = -1;
+	return err;
+}
+
+TraceRecorder::~TraceRecorder() { close(); }
+
+// ReplayCamera::Error
+
+ReplayCamera::Error::Error(ReplayCamera::Error::ErrorValue value) noexcept : value(value) { }
+
+ReplayCamera::Error::operator int() const noexcept { return value; }
+
+// ReplayCamera
+
+ReplayCamera::ReplayCamera(const char* tracePath) noexcept : tracePath(tracePath) {
+	bzero(&format, sizeof(format));
+	format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	bzero(&bufferMetadata, sizeof(bufferMetadata));
+	bufferMetadata.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	bufferMetadata.memory = V4L2_MEMORY_MMAP;
+
+	bzero(&bufferData, sizeof(bufferData));
+	bufferData.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	bufferData.memory = V4L2_MEMORY_MMAP;
+}
+
+ReplayCamera::Error ReplayCamera::open() {
+	if (fd != -1) { return Error::not_closed; }
+	fd = ::open(tracePath, O_RDONLY);
+	if (fd == -1) { return Error::file_open_failed; }
+	return Error::none;
+}
+
+ReplayCamera::Error ReplayCamera::init() {
+	if (initialized) { return Error::not_freed; }
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) { return Error::status_info_unavailable; }
+	if ((size_t)st.st_size < firstRecordOffset) { return Error::trace_invalid; }
+	mappingSize = st.st_size;
+
+	// NOTE: MAP_PRIVATE with write access, so that code which processes frames in place (which works with real camera buffers) keeps working.
+	// Writes end up in private copies of the touched pages and never in the trace file.
+	void* result = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | (preload ? MAP_POPULATE : 0), fd, 0);
+	if (result == MAP_FAILED) { return Error::mmap_failed; }
+	mapping = (uint8_t*)result;
+	if (!preload) { madvise(mapping, mappingSize, MADV_SEQUENTIAL); }
+
+	const TraceHeader& header = *(const TraceHeader*)mapping;
+	if (header.magic != traceMagic || header.version != traceVersion || header.bufferCount == 0 || header.bufferCount > VIDEO_MAX_FRAME) {
+		munmap(mapping, mappingSize);
+		return Error::trace_invalid;
+	}
+
+	bzero(&format, sizeof(format));
+	format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	format.fmt.pix.width = header.width;
+	format.fmt.pix.height = header.height;
+	format.fmt.pix.pixelformat = header.pixelFormat;
+	format.fmt.pix.field = header.field;
+	format.fmt.pix.bytesperline = header.bytesPerLine;
+	format.fmt.pix.sizeimage = header.sizeImage;
+	bufferMetadata.count = header.bufferCount;
+	lastBufferIndex = bufferMetadata.count - 1;
+	for (uint32_t i = 0; i < bufferMetadata.count; i++) { frameLocations[i] = { nullptr, 0 }; }
+
+	bufferData.index = 0;
+	queuedFramesCount = 0;
+	queueHead = 0;
+	nextRecordOffset = firstRecordOffset;
+	replayedFrameCount = 0;
+	initialized = true;
+	return Error::none;
+}
+
+ReplayCamera::Error ReplayCamera::start() { streaming = true; return Error::none; }
+
+bool ReplayCamera::isFrameCorrupted() const noexcept { return bufferData.flags & V4L2_BUF_FLAG_ERROR; }
+
+ReplayCamera::Error ReplayCamera::queueFrame() {
+	if (!initialized || queuedFramesCount == bufferMetadata.count) { return Error::device_queue_buffer_failed; }
+	queuedIndices[(queueHead + queuedFramesCount) % VIDEO_MAX_FRAME] = bufferData.index;
+	queuedFramesCount++;
+	if (bufferData.index == lastBufferIndex) { bufferData.index = 0; return Error::none; }
+	bufferData.index++;
+	return Error::none;
+}
+
+ReplayCamera::Error ReplayCamera::dequeueFrame() {
+	if (queuedFramesCount == 0 || !streaming) { return Error::dequeue_frame_impossible; }
+
+	// A record that doesn't fit is what's left of a recording that got cut off, so treat it as the end.
+	const TraceRecord* record = (const TraceRecord*)(mapping + nextRecordOffset);
+	bool atEnd = nextRecordOffset + sizeof(TraceRecord) > mappingSize || record->recordSize < sizeof(TraceRecord) + record->bytesused ||
+		     nextRecordOffset + record->recordSize > mappingSize;
+	if (atEnd) {
+		if (!loop || nextRecordOffset == firstRecordOffset) { return Error::end_of_trace; }
+		nextRecordOffset = firstRecordOffset;
+		record = (const TraceRecord*)(mapping + nextRecordOffset);
+	}
+
+	int64_t timestamp = record->timestampSeconds * 1000000 + record->timestampMicroseconds;
+	if (nextRecordOffset == firstRecordOffset) {
+		clock_gettime(CLOCK_MONOTONIC, &replayStart);
+		firstTimestamp = timestamp;
+	} else if (realTime) {
+		// NOTE: Timestamps can go backwards in a trace (clock adjustments, a looped recording). Those frames are just served right away,
+		// a negative delay would make tv_nsec negative and clock_nanosleep() would fail with EINVAL.
+		int64_t delay = timestamp > firstTimestamp ? timestamp - firstTimestamp : 0;
+		timespec target;
+		target.tv_sec = replayStart.tv_sec + delay / 1000000;
+		target.tv_nsec = replayStart.tv_nsec + (delay % 1000000) * 1000;
+		if (target.tv_nsec >= 1000000000) { target.tv_sec++; target.tv_nsec -= 1000000000; }
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, nullptr) == EINTR) { }
+	}
+
+	uint32_t index = queuedIndices[queueHead];
+	queueHead = (queueHead + 1) % VIDEO_MAX_FRAME;
+	queuedFramesCount--;
+
+	frameLocations[index].start = (uint8_t*)(record + 1);
+	frameLocations[index].size = record->bytesused;
+	bufferData.index = index;
+	bufferData.timestamp.tv_sec = record->timestampSeconds;
+	bufferData.timestamp.tv_usec = record->timestampMicroseconds;
+	bufferData.sequence = record->sequence;
+	bufferData.flags = record->flags;
+	bufferData.bytesused = record->bytesused;
+	bufferData.field = record->field;
+	bufferData.length = record->bytesused;
+
+	nextRecordOffset += record->recordSize;
+	replayedFrameCount++;
+	return Error::none;
+}
+
+ReplayCamera::Error ReplayCamera::queueAllFrames() {
+	bufferData.index = 0;
+	Error err = queueFrame(); if (err != Error::none) { return err; }
+	while (bufferData.index != 0) { err = queueFrame(); if (err != Error::none) { return err; } }
+	return Error::none;
+}
+
+ReplayCamera::Error ReplayCamera::dequeueAllFrames() {
+	while (queuedFramesCount != 0) { Error err = dequeueFrame(); if (err != Error::none) { return err; } }
+	return Error::none;
+}
+
+ReplayCamera::Error ReplayCamera::shootFrame() {
+	Error err = dequeueAllFrames(); if (err != Error::none && err != Error::dequeue_frame_impossible) { return err; }
+	err = queueFrame(); if (err != Error::none) { return err; }
+	return dequeueFrame();
+}
+
+ReplayCamera::Error ReplayCamera::stop() {
+	streaming = false;
+	queuedFramesCount = 0;
+	return Error::none;
+}
+
+ReplayCamera::Error ReplayCamera::free() {
+	if (!initialized) { return Error::already_freed; }
+	stop();
+	if (munmap(mapping, mappingSize) == -1) { return Error::munmap_failed; }
+	initialized = false;
+	return Error::none;
+}
+
+ReplayCamera::Error ReplayCamera::close() {
+	if (fd == -1) { return Error::already_closed; }
+	Error err = free(); if (err != Error::none && err != Error::already_freed) { return err; }
+	if (::close(fd) == -1) { fd = -1; return Error::file_close_failed; }
+	fd = -1;
+	return Error::none;
+}
+
+ReplayCamera::~ReplayCamera() { close(); }
@@ -0,0 +1,250 @@
+#include "../include/Executor.h"
+#include "../include/Camera.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <coroutine>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <functional>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <linux/videodev2.h>
+
+using namespace vid;
+
+// Executor::Error
+
+Executor::Error::Error(Executor::Error::ErrorValue value) noexcept : value(value) { }
+
+Executor::Error::operator int() const noexcept { return value; }
+
+// Executor
+
+// Resumes ready coroutines until the executor stops and the ready queue is empty.
+static void workerLoop(Executor& executor) {
+	while (true) {
+		std::unique_lock<std::mutex> lock(executor.mutex);
+		executor.readyCondition.wait(lock, [&executor] { return executor.readyCount != 0 || executor.stopping; });
+		if (executor.readyCount == 0) { return; }
+		std::coroutine_handle<> handle = executor.readyQueue[executor.readyHead];
+		executor.readyHead = (executor.readyHead + 1) % Executor::readyQueueCapacity;
+		executor.readyCount--;
+		lock.unlock();
+		executor.spaceCondition.notify_one();
+		handle.resume();
+	}
+}
+
+Executor::Error Executor::init(uint32_t workerCount) {
+	if (initialized) { return Error::not_freed; }
+	if (workerCount == 0 || workerCount > maxWorkerCount) { return Error::invalid_worker_count; }
+
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (epollFd == -1) { return Error::epoll_create_failed; }
+	wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (wakeFd == -1) { ::close(epollFd); epollFd = -1; return Error::eventfd_create_failed; }
+	epoll_event event = { };
+	event.events = EPOLLIN;
+	event.data.ptr = nullptr;			// NOTE: Watchers are never null, so nullptr marks the wake up eventfd.
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) == -1) { ::close(wakeFd); ::close(epollFd); wakeFd = -1; epollFd = -1; return Error::watch_failed; }
+
+	readyHead = 0;
+	readyCount = 0;
+	stopping = false;
+	this->workerCount = workerCount;
+	for (uint32_t i = 0; i < workerCount; i++) { workers[i] = std::thread(workerLoop, std::ref(*this)); }
+	initialized = true;
+	return Error::none;
+}
+
+void Executor::schedule(std::coroutine_handle<> handle) {
+	std::unique_lock<std::mutex> lock(mutex);
+	spaceCondition.wait(lock, [this] { return readyCount != readyQueueCapacity; });
+	readyQueue[(readyHead + readyCount) % readyQueueCapacity] = handle;
+	readyCount++;
+	lock.unlock();
+	readyCondition.notify_one();
+}
+
+Executor::Error Executor::watch(int fd, Watcher& watcher) {
+	// NOTE: EPOLLONESHOT disables the fd after one wake up, so the watcher gets called exactly once. The fd stays in the epoll set afterwards,
+	// which is why this tries re-arming it with EPOLL_CTL_MOD first and only adds it if it isn't in the set yet.
+	epoll_event event = { };
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.ptr = &watcher;
+	if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == -1) {
+		if (errno != ENOENT || epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1) { return Error::watch_failed; }
+	}
+	return Error::none;
+}
+
+Executor::Error Executor::run() {
+	epoll_event events[16];
+	while (true) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (stopping) { return Error::none; }
+		}
+		int count = epoll_wait(epollFd, events, 16, -1);
+		if (count == -1) { if (errno == EINTR) { continue; } return Error::epoll_wait_failed; }
+		for (int i = 0; i < count; i++) {
+			if (events[i].data.ptr == nullptr) { uint64_t value; (void)read(wakeFd, &value, sizeof(value)); continue; }
+			Watcher& watcher = *(Watcher*)events[i].data.ptr;
+			watcher.ready(watcher);
+		}
+	}
+}
+
+void Executor::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	readyCondition.notify_all();
+	uint64_t value = 1;
+	(void)write(wakeFd, &value, sizeof(value));
+}
+
+// NOTE: Coroutines that are still waiting on a file descriptor when the executor gets freed never get resumed, their frames are leaked.
+// Let them finish (e.g. stop the camera so they get an error lease and return) before calling this.
+Executor::Error Executor::free() {
+	if (!initialized) { return Error::already_freed; }
+	stop();
+	for (uint32_t i = 0; i < workerCount; i++) { workers[i].join(); }
+	::close(wakeFd);
+	::close(epollFd);
+	wakeFd = -1;
+	epollFd = -1;
+	initialized = false;
+	return Error::none;
+}
+
+Executor::~Executor() { free(); }
+
+// FrameLease
+
+FrameLease::FrameLease() noexcept : error(Camera::Error::dequeue_frame_impossible), generation(0), index(0), data(nullptr), bytesused(0), sequence(0), flags(0), timestamp { } { }
+
+FrameLease::FrameLease(FrameLease&& other) noexcept { *this = std::move(other); }
+
+FrameLease& FrameLease::operator=(FrameLease&& other) noexcept {
+	if (this == &other) { return *this; }
+	release();
+	camera = other.camera;
+	error = other.error;
+	generation = other.generation;
+	index = other.index;
+	data = other.data;
+	bytesused = other.bytesused;
+	sequence = other.sequence;
+	flags = other.flags;
+	timestamp = other.timestamp;
+	other.camera = nullptr;
+	return *this;
+}
+
+FrameLease::operator bool() const noexcept { return camera && error == Camera::Error::none; }
+
+int FrameLease::release() noexcept {
+	if (!camera) { return Camera::Error::none; }
+	Camera& owner = *camera;
+	camera = nullptr;
+	// The buffer of a stale lease was already taken back by the driver in stop(), queueing it again would go to a stopped (or freed) queue.
+	if (std::atomic_ref<uint32_t>(owner.streamGeneration).load() != generation) { return Camera::Error::stale_frame_lease; }
+	int err = owner.queueFrame(index);
+	std::atomic_ref<uint32_t>(owner.leasedFramesCount).fetch_sub(1);
+	FrameAwaitable::wakeParked(owner);
+	return err;
+}
+
+FrameLease::~FrameLease() { release(); }
+
+// FrameAwaitable
+
+// NOTE: A FrameAwaitable can be waiting in three places: on the fd (after Executor::watch()), parked on the camera (Camera::parkedFrameAwaitable
+// and Camera::parkedTicket, while every buffer is leased out), or in the executor's ready queue. Whoever takes it out of one of those owns it until they put it somewhere else,
+// and nobody may touch it after that, because it lives in the coroutine frame, which can be resumed (and destroyed) on another thread right away.
+
+FrameAwaitable::FrameAwaitable(Camera& camera, Executor& executor) noexcept : camera(camera), executor(executor) {
+	ready = onReadable;
+	generation = std::atomic_ref<uint32_t>(camera.streamGeneration).load();
+}
+
+// Returns false if there was nothing to dequeue. Otherwise result holds the frame or the error.
+bool FrameAwaitable::tryDequeue() noexcept {
+	if (std::atomic_ref<uint32_t>(camera.streamGeneration).load() != generation) { result.error = Camera::Error::dequeue_frame_impossible; return true; }
+	v4l2_buffer buffer;
+	Camera::Error err = camera.tryDequeueFrame(buffer);
+	result.error = err;
+	if (err == Camera::Error::dequeue_frame_impossible) {
+		// Nothing queued and nothing leased means nothing is ever going to show up, so that's a real error.
+		return std::atomic_ref<uint32_t>(camera.leasedFramesCount).load() == 0 && camera.getQueuedFramesCount() == 0;
+	}
+	// NOTE: If recording the frame failed, it's still dequeued, so the lease takes it anyway (and requeues it), it just reports the error.
+	if (err != Camera::Error::none && err != Camera::Error::trace_write_failed) { return true; }
+	std::atomic_ref<uint32_t>(camera.leasedFramesCount).fetch_add(1);
+	result.camera = &camera;
+	result.generation = generation;
+	result.index = buffer.index;
+	result.data = camera.frameLocations[buffer.index].start;
+	result.bytesused = buffer.bytesused;
+	result.sequence = buffer.sequence;
+	result.flags = buffer.flags;
+	result.timestamp = buffer.timestamp;
+	return true;
+}
+
+// Parks this on the camera until a lease gets released. Returns false if the situation changed while parking and this still belongs to the caller.
+bool FrameAwaitable::park() noexcept {
+	Camera& camera = this->camera;
+	uint32_t generation = this->generation;
+	std::atomic_ref<uint32_t> parkedTicket(camera.parkedTicket);
+	uint32_t ticket;
+	do { ticket = std::atomic_ref<uint32_t>(camera.lastParkTicket).fetch_add(1) + 1; } while (ticket == 0);
+	std::atomic_ref<FrameAwaitable*>(camera.parkedFrameAwaitable).store(this);
+	parkedTicket.store(ticket);
+	// NOTE: Everything is seq_cst. Whoever releases a lease or stops the camera changes the counters first and then takes the parked awaitable,
+	// so either the checks below see their change, or they see this parked.
+	if (camera.getQueuedFramesCount() == 0 && std::atomic_ref<uint32_t>(camera.leasedFramesCount).load() != 0 &&
+	    std::atomic_ref<uint32_t>(camera.streamGeneration).load() == generation) { return true; }
+	// NOTE: Only take back our own parking. If the ticket is gone, someone else took over and may already have resumed the coroutine,
+	// which may have parked again (possibly at the same address), so neither the slot nor *this can be touched anymore.
+	uint32_t expected = ticket;
+	return !parkedTicket.compare_exchange_strong(expected, 0);
+}
+
+// Keeps going until there's a result (then schedules the coroutine) or the awaitable is handed off to the fd or the camera.
+void FrameAwaitable::advance() noexcept {
+	while (true) {
+		if (tryDequeue()) { executor.schedule(handle); return; }
+		if (camera.getQueuedFramesCount() == 0) {
+			if (park()) { return; }
+			continue;
+		}
+		if (executor.watch(camera.fd, *this) != Executor::Error::none) { result.error = Camera::Error::poll_failed; executor.schedule(handle); }
+		return;
+	}
+}
+
+void FrameAwaitable::onReadable(Executor::Watcher& watcher) noexcept { static_cast<FrameAwaitable&>(watcher).advance(); }
+
+void FrameAwaitable::wakeParked(Camera& camera) noexcept {
+	if (std::atomic_ref<uint32_t>(camera.parkedTicket).exchange(0) == 0) { return; }
+	// Taking the ticket makes this the owner, nothing can park again until the awaitable continues, so the pointer can't change under us.
+	std::atomic_ref<FrameAwaitable*>(camera.parkedFrameAwaitable).load()->advance();
+}
+
+bool FrameAwaitable::await_ready() noexcept { return tryDequeue(); }
+
+// NOTE: Spurious wake ups (readable without a finished buffer) and waiting for leases are handled in advance(), so the coroutine only ever resumes with a result.
+void FrameAwaitable::await_suspend(std::coroutine_handle<> handle) noexcept {
+	this->handle = handle;
+	advance();
+}
+
+FrameLease FrameAwaitable::await_resume() noexcept { return std::move(result); }
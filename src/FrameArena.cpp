@@ -0,0 +1,98 @@
+#include "../include/FrameArena.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <sys/mman.h>
+
+#include <linux/videodev2.h>
+
+using namespace vid;
+
+// FrameArena::Error
+
+FrameArena::Error::Error(FrameArena::Error::ErrorValue value) noexcept : value(value) { }
+
+FrameArena::Error::operator int() const noexcept { return value; }
+
+// FrameArena
+
+static size_t alignUp(size_t size) noexcept { return (size + FrameArena::alignment - 1) & ~(FrameArena::alignment - 1); }
+
+FrameArena::Error FrameArena::plan(const char* name, size_t size, uint32_t& handle) {
+	if (initialized) { return Error::already_initialized; }
+	if (bufferCount == maxBufferCount) { return Error::too_many_buffers; }
+	buffers[bufferCount] = { name, plannedSize, size };
+	plannedSize += alignUp(size);
+	handle = bufferCount++;
+	return Error::none;
+}
+
+FrameArena::Error FrameArena::planFormat(const v4l2_format& format, uint32_t preRollFrameCount, FormatLayout& layout) {
+	const v4l2_pix_format& pix = format.fmt.pix;
+	if (pix.width == 0 || pix.height == 0 || pix.sizeimage == 0) { return Error::format_unsupported; }
+
+	layout.width = pix.width;
+	layout.height = pix.height;
+	layout.frameSize = pix.sizeimage;
+	layout.preRollFrameCount = preRollFrameCount;
+	size_t planeSize = (size_t)pix.width * pix.height;
+
+	Error err = plan("current luma", planeSize, layout.currentLuma); if (err != Error::none) { return err; }
+	err = plan("previous luma", planeSize, layout.previousLuma); if (err != Error::none) { return err; }
+	err = plan("difference map", planeSize, layout.differenceMap); if (err != Error::none) { return err; }
+	err = plan("conversion scratch", pix.sizeimage, layout.conversionScratch); if (err != Error::none) { return err; }
+	return plan("pre-roll", (size_t)preRollFrameCount * pix.sizeimage, layout.preRoll);
+}
+
+FrameArena::Error FrameArena::reserveScratch(size_t size) {
+	if (initialized) { return Error::already_initialized; }
+	scratchSize = alignUp(size);
+	return Error::none;
+}
+
+size_t FrameArena::requiredSize() const noexcept { return plannedSize + scratchSize; }
+
+FrameArena::Error FrameArena::init(size_t budget) {
+	if (initialized) { return Error::not_freed; }
+	memorySize = requiredSize();
+	if (budget != 0 && memorySize > budget) { return Error::budget_exceeded; }
+
+	// NOTE: mmap instead of malloc because it hands us page aligned memory that goes straight back to the OS in free(), instead of sitting in the heap.
+	// MAP_POPULATE faults every page in right now instead of on first touch inside the hot path.
+	if (memorySize != 0) {
+		void* mapping = mmap(nullptr, memorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+		if (mapping == MAP_FAILED) { return Error::mmap_failed; }
+		memory = (uint8_t*)mapping;
+		mlock(memory, memorySize);			// Best effort, fails without CAP_IPC_LOCK or a high enough RLIMIT_MEMLOCK, no need to handle error here.
+	} else { memory = nullptr; }
+
+	scratchUsed = 0;
+	peakScratchUsed = 0;
+	failedScratchAllocations = 0;
+	initialized = true;
+	return Error::none;
+}
+
+void* FrameArena::get(uint32_t handle) const noexcept { return memory + buffers[handle].offset; }
+
+void* FrameArena::allocateScratch(size_t size) noexcept {
+	size = alignUp(size);
+	if (scratchSize - scratchUsed < size) { failedScratchAllocations++; return nullptr; }
+	void* result = memory + plannedSize + scratchUsed;
+	scratchUsed += size;
+	if (scratchUsed > peakScratchUsed) { peakScratchUsed = scratchUsed; }
+	return result;
+}
+
+void FrameArena::resetScratch() noexcept { scratchUsed = 0; }
+
+size_t FrameArena::peakUsage() const noexcept { return plannedSize + peakScratchUsed; }
+
+FrameArena::Error FrameArena::free() {
+	if (!initialized) { return Error::already_freed; }
+	if (memory && munmap(memory, memorySize) == -1) { return Error::munmap_failed; }
+	initialized = false;
+	return Error::none;
+}
+
+FrameArena::~FrameArena() { free(); }
@@ -0,0 +1,201 @@
+#include "../include/FrameStatistics.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <linux/videodev2.h>
+
+using namespace vid;
+
+// FrameStatistics::Error
+
+FrameStatistics::Error::Error(FrameStatistics::Error::ErrorValue value) noexcept : value(value) { }
+
+FrameStatistics::Error::operator int() const noexcept { return value; }
+
+// FrameStatistics
+
+// Adds up the values and the squares of the values of count bytes. count is at most maxTileSize, so 32 bit lanes can't overflow.
+static void sumAndSquares(const uint8_t* values, uint32_t count, uint32_t& sum, uint32_t& sumSquares) noexcept {
+	uint32_t i = 0;
+	uint32_t s = 0, sq = 0;
+#if defined(__ARM_NEON)
+	uint32x4_t sums = vdupq_n_u32(0);
+	uint32x4_t squares = vdupq_n_u32(0);
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t bytes = vld1q_u8(values + i);
+		sums = vpadalq_u16(sums, vpaddlq_u8(bytes));
+		squares = vpadalq_u16(squares, vmull_u8(vget_low_u8(bytes), vget_low_u8(bytes)));
+		squares = vpadalq_u16(squares, vmull_u8(vget_high_u8(bytes), vget_high_u8(bytes)));
+	}
+	uint64x2_t pairs = vpaddlq_u32(sums);			// NOTE: No vaddvq_u32(), that only exists on AArch64 and the Pi might run a 32 bit OS.
+	s = vgetq_lane_u64(pairs, 0) + vgetq_lane_u64(pairs, 1);
+	pairs = vpaddlq_u32(squares);
+	sq = vgetq_lane_u64(pairs, 0) + vgetq_lane_u64(pairs, 1);
+#elif defined(__SSE2__)
+	__m128i zero = _mm_setzero_si128();
+	__m128i sums = _mm_setzero_si128();
+	__m128i squares = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(values + i));
+		sums = _mm_add_epi64(sums, _mm_sad_epu8(bytes, zero));
+		__m128i low = _mm_unpacklo_epi8(bytes, zero);
+		__m128i high = _mm_unpackhi_epi8(bytes, zero);
+		squares = _mm_add_epi32(squares, _mm_madd_epi16(low, low));
+		squares = _mm_add_epi32(squares, _mm_madd_epi16(high, high));
+	}
+	s = _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+	squares = _mm_add_epi32(squares, _mm_srli_si128(squares, 8));
+	squares = _mm_add_epi32(squares, _mm_srli_si128(squares, 4));
+	sq = _mm_cvtsi128_si32(squares);
+#endif
+	for (; i < count; i++) { s += values[i]; sq += values[i] * values[i]; }
+	sum += s;
+	sumSquares += sq;
+}
+
+// Copies every other byte of source into destination, count bytes in total. That's the luma of a YUYV row.
+static void extractEvenBytes(const uint8_t* source, uint8_t* destination, uint32_t count) noexcept {
+	uint32_t i = 0;
+#if defined(__ARM_NEON)
+	for (; i + 16 <= count; i += 16) { vst1q_u8(destination + i, vld2q_u8(source + i * 2).val[0]); }
+#elif defined(__SSE2__)
+	__m128i evenMask = _mm_set1_epi16(0x00FF);
+	for (; i + 16 <= count; i += 16) {
+		__m128i low = _mm_and_si128(_mm_loadu_si128((const __m128i*)(source + i * 2)), evenMask);
+		__m128i high = _mm_and_si128(_mm_loadu_si128((const __m128i*)(source + i * 2 + 16)), evenMask);
+		_mm_storeu_si128((__m128i*)(destination + i), _mm_packus_epi16(low, high));
+	}
+#endif
+	for (; i < count; i++) { destination[i] = source[i * 2]; }
+}
+
+FrameStatistics::Error FrameStatistics::init(const v4l2_format& format, uint32_t tileSize) {
+	if (initialized) { return Error::not_freed; }
+	const v4l2_pix_format& pix = format.fmt.pix;
+	switch (pix.pixelformat) {
+	case V4L2_PIX_FMT_GREY: case V4L2_PIX_FMT_YUYV: case V4L2_PIX_FMT_RGB24: case V4L2_PIX_FMT_BGR24: break;
+	default: return Error::format_unsupported;
+	}
+	if (tileSize == 0 || tileSize > maxTileSize) { return Error::invalid_tile_size; }
+	if (pix.width == 0 || pix.height == 0 || pix.width > maxWidth) { return Error::frame_too_large; }
+
+	pixelFormat = pix.pixelformat;
+	width = pix.width;
+	height = pix.height;
+	this->tileSize = tileSize;
+	tilesPerRow = (width + tileSize - 1) / tileSize;
+	tilesPerColumn = (height + tileSize - 1) / tileSize;
+	if (tilesPerRow * tilesPerColumn > maxTileCount) { return Error::frame_too_large; }
+
+	initialized = true;
+	return Error::none;
+}
+
+void FrameStatistics::beginFrame() noexcept {
+	memset(subHistograms, 0, sizeof(subHistograms));
+	memset(tileSums, 0, tilesPerRow * tilesPerColumn * sizeof(uint32_t));
+	memset(tileSumSquares, 0, tilesPerRow * tilesPerColumn * sizeof(uint32_t));
+}
+
+void FrameStatistics::processRow(const uint8_t* row, uint32_t y) noexcept {
+	// NOTE: Everything the loops need is copied into locals first. The loops write through uint8_t/uint32_t pointers, which the compiler has to assume
+	// could point at the members, so it would reload them every iteration and refuse to vectorize otherwise.
+	const uint32_t width = this->width;
+	const uint32_t tileSize = this->tileSize;
+
+	// Get the luma of the row. GREY already is luma, the others get converted into lumaRow (BT.601 weights for RGB).
+	const uint8_t* luma = lumaRow;
+	uint8_t* output = lumaRow;
+	switch (pixelFormat) {
+	case V4L2_PIX_FMT_GREY: luma = row; break;
+	case V4L2_PIX_FMT_YUYV: extractEvenBytes(row, output, width); break;
+	case V4L2_PIX_FMT_RGB24: for (uint32_t x = 0; x < width; x++) { output[x] = (row[x * 3] * 77 + row[x * 3 + 1] * 150 + row[x * 3 + 2] * 29 + 128) >> 8; } break;
+	case V4L2_PIX_FMT_BGR24: for (uint32_t x = 0; x < width; x++) { output[x] = (row[x * 3 + 2] * 77 + row[x * 3 + 1] * 150 + row[x * 3] * 29 + 128) >> 8; } break;
+	}
+
+	uint32_t* histogram0 = subHistograms[0];
+	uint32_t* histogram1 = subHistograms[1];
+	uint32_t* histogram2 = subHistograms[2];
+	uint32_t* histogram3 = subHistograms[3];
+	uint32_t x = 0;
+	for (; x + 4 <= width; x += 4) {
+		histogram0[luma[x]]++;
+		histogram1[luma[x + 1]]++;
+		histogram2[luma[x + 2]]++;
+		histogram3[luma[x + 3]]++;
+	}
+	for (; x < width; x++) { histogram0[luma[x]]++; }
+
+	uint32_t* sums = tileSums + (y / tileSize) * tilesPerRow;
+	uint32_t* sumSquares = tileSumSquares + (y / tileSize) * tilesPerRow;
+	const uint32_t tilesPerRow = this->tilesPerRow;
+	for (uint32_t tileX = 0; tileX < tilesPerRow; tileX++) {
+		uint32_t left = tileX * tileSize;
+		sumAndSquares(luma + left, std::min(tileSize, width - left), sums[tileX], sumSquares[tileX]);
+	}
+}
+
+void FrameStatistics::finishFrame() noexcept {
+	uint64_t sum = 0, sumSquares = 0;
+	for (uint32_t value = 0; value < 256; value++) {
+		histogram[value] = subHistograms[0][value] + subHistograms[1][value] + subHistograms[2][value] + subHistograms[3][value];
+		sum += (uint64_t)histogram[value] * value;
+		sumSquares += (uint64_t)histogram[value] * value * value;
+	}
+	pixelCount = (uint64_t)width * height;
+	mean = (double)sum / pixelCount;
+	variance = (double)sumSquares / pixelCount - (double)mean * mean;
+
+	lowClippedCount = 0;
+	for (uint32_t value = 0; value <= lowClipLevel; value++) { lowClippedCount += histogram[value]; }
+	highClippedCount = 0;
+	for (uint32_t value = highClipLevel; value < 256; value++) { highClippedCount += histogram[value]; }
+
+	uint32_t tileCount = tilesPerRow * tilesPerColumn;
+	uint32_t unclippedTileCount = 0;
+	for (uint32_t tile = 0; tile < tileCount; tile++) {
+		uint32_t tileWidth = std::min(tileSize, width - (tile % tilesPerRow) * tileSize);
+		uint32_t tileHeight = std::min(tileSize, height - (tile / tilesPerRow) * tileSize);
+		float count = tileWidth * tileHeight;
+		tileMeans[tile] = tileSums[tile] / count;
+		tileVariances[tile] = std::max(tileSumSquares[tile] / count - tileMeans[tile] * tileMeans[tile], 0.0f);
+		// NOTE: Clipped tiles have (almost) no variance, but that isn't because they're noise free, so they would drag the estimate down.
+		if (tileMeans[tile] > lowClipLevel + 2 && tileMeans[tile] < highClipLevel - 2) { sortScratch[unclippedTileCount++] = tileVariances[tile]; }
+	}
+
+	noiseEstimate = 0;
+	if (unclippedTileCount != 0) {
+		uint32_t percentileIndex = std::min<uint32_t>(unclippedTileCount * noisePercentile, unclippedTileCount - 1);
+		std::nth_element(sortScratch, sortScratch + percentileIndex, sortScratch + unclippedTileCount);
+		noiseEstimate = std::sqrt(sortScratch[percentileIndex]);
+	}
+	suggestedThreshold = (uint8_t)std::clamp<float>(noiseEstimate * noiseFactor + 0.5f, minThreshold, maxThreshold);
+
+	float lowFraction = (float)lowClippedCount / pixelCount;
+	float highFraction = (float)highClippedCount / pixelCount;
+	exposure = Exposure::normal;
+	if (lowFraction > maxClippedFraction || highFraction > maxClippedFraction) { exposure = lowFraction > highFraction ? Exposure::underexposed : Exposure::overexposed; }
+}
+
+void FrameStatistics::compute(const void* frame, uint32_t bytesPerLine) noexcept {
+	const uint8_t* rows = (const uint8_t*)frame;
+	beginFrame();
+	for (uint32_t y = 0; y < height; y++) { processRow(rows + (size_t)y * bytesPerLine, y); }
+	finishFrame();
+}
+
+FrameStatistics::Error FrameStatistics::free() {
+	if (!initialized) { return Error::already_freed; }
+	initialized = false;
+	return Error::none;
+}
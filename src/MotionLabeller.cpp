@@ -0,0 +1,262 @@
+#include "../include/MotionLabeller.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <barrier>
+
+using namespace vid;
+
+// MotionLabeller::Error
+
+MotionLabeller::Error::Error(MotionLabeller::Error::ErrorValue value) noexcept : value(value) { }
+
+MotionLabeller::Error::operator int() const noexcept { return value; }
+
+// MotionLabeller
+
+static constexpr uint32_t emptySlot = UINT32_MAX;
+
+// Finds the root of i and halves the path on the way. Only used where no other thread can touch the links of the path.
+static uint32_t findRoot(uint32_t* parents, uint32_t i) noexcept {
+	while (parents[i] != i) { parents[i] = parents[parents[i]]; i = parents[i]; }
+	return i;
+}
+
+// Same as findRoot(), but doesn't write anything, so multiple threads can use it at the same time.
+static uint32_t findRootReadOnly(const uint32_t* parents, uint32_t i) noexcept {
+	while (parents[i] != i) { i = parents[i]; }
+	return i;
+}
+
+// NOTE: The smaller index always becomes the root. That keeps the root of every component at its topmost cell, which is always in the topmost band.
+static void unite(uint32_t* parents, uint32_t a, uint32_t b) noexcept {
+	a = findRoot(parents, a);
+	b = findRoot(parents, b);
+	if (a < b) { parents[b] = a; }
+	else if (b < a) { parents[a] = b; }
+}
+
+static uint32_t hashRoot(uint32_t root, uint32_t tableSize) noexcept { return (root * 2654435761u) & (tableSize - 1); }
+
+// Returns the slot for root in table, claiming an empty one if root isn't in there yet. Returns emptySlot if the table is too full.
+static uint32_t findSlot(MotionLabeller::ComponentStats* table, uint32_t tableSize, uint32_t* usedSlots, uint32_t& usedCount, uint32_t root) noexcept {
+	uint32_t slot = hashRoot(root, tableSize);
+	while (table[slot].root != emptySlot) {
+		if (table[slot].root == root) { return slot; }
+		slot = (slot + 1) & (tableSize - 1);
+	}
+	if (usedCount >= tableSize / 4 * 3) { return emptySlot; }		// keep probe sequences short
+	table[slot] = { root, 0, UINT32_MAX, UINT32_MAX, 0, 0, 0, 0 };
+	usedSlots[usedCount++] = slot;
+	return slot;
+}
+
+size_t MotionLabeller::requiredSize(uint32_t width, uint32_t height) noexcept { return (size_t)width * height * sizeof(uint32_t); }
+
+MotionLabeller::Error MotionLabeller::init(uint32_t width, uint32_t height, uint32_t threadCount, void* memory) {
+	if (initialized) { return Error::not_freed; }
+	if (width == 0 || height == 0 || (uint64_t)width * height >= UINT32_MAX) { return Error::invalid_size; }
+	if (threadCount == 0 || threadCount > maxThreadCount || threadCount > height) { return Error::invalid_thread_count; }
+
+	this->width = width;
+	this->height = height;
+	this->threadCount = threadCount;
+	parents = (uint32_t*)memory;
+
+	for (uint32_t i = 0; i < threadCount; i++) {
+		Band& band = bands[i];
+		band.top = height * i / threadCount;
+		band.bottom = height * (i + 1) / threadCount;
+		for (uint32_t slot = 0; slot < bandTableSize; slot++) { band.table[slot].root = emptySlot; }
+		band.usedCount = 0;
+	}
+	for (uint32_t slot = 0; slot < mergeTableSize; slot++) { mergeTable[slot].root = emptySlot; }
+
+	objectCount = 0;
+	previousObjectCount = 0;
+	stopping = false;
+	startBarrier.emplace(threadCount);
+	seamBarrier.emplace(threadCount, SeamMerge { this });
+	endBarrier.emplace(threadCount);
+	for (uint32_t i = 0; i < threadCount - 1; i++) { workers[i] = std::thread(&MotionLabeller::work, this, i); }
+
+	initialized = true;
+	return Error::none;
+}
+
+void MotionLabeller::labelBand(Band& band) noexcept {
+	for (uint32_t y = band.top; y < band.bottom; y++) {
+		const uint8_t* row = mask + y * stride;
+		const uint8_t* rowAbove = row - stride;
+		bool hasRowAbove = y != band.top;			// the row above the band belongs to the next thread, that gets handled in mergeSeams()
+		for (uint32_t x = 0; x < width; x++) {
+			if (row[x] < maskThreshold) { continue; }
+			uint32_t cell = y * width + x;
+			parents[cell] = cell;
+			if (x != 0 && row[x - 1] >= maskThreshold) { unite(parents, cell, cell - 1); }
+			if (!hasRowAbove) { continue; }
+			// 8-connectivity, so that diagonal edges of moving objects don't fall apart
+			if (rowAbove[x] >= maskThreshold) { unite(parents, cell, cell - width); continue; }	// up-left and up-right are connected to up already if up is set
+			if (x != 0 && rowAbove[x - 1] >= maskThreshold) { unite(parents, cell, cell - width - 1); }
+			if (x + 1 != width && rowAbove[x + 1] >= maskThreshold) { unite(parents, cell, cell - width + 1); }
+		}
+	}
+}
+
+void MotionLabeller::mergeSeams() noexcept {
+	for (uint32_t i = 1; i < threadCount; i++) {
+		uint32_t y = bands[i].top;
+		const uint8_t* row = mask + y * stride;
+		const uint8_t* rowAbove = row - stride;
+		for (uint32_t x = 0; x < width; x++) {
+			if (row[x] < maskThreshold) { continue; }
+			uint32_t cell = y * width + x;
+			if (x != 0 && rowAbove[x - 1] >= maskThreshold) { unite(parents, cell, cell - width - 1); }
+			if (rowAbove[x] >= maskThreshold) { unite(parents, cell, cell - width); }
+			if (x + 1 != width && rowAbove[x + 1] >= maskThreshold) { unite(parents, cell, cell - width + 1); }
+		}
+	}
+}
+
+void MotionLabeller::SeamMerge::operator()() noexcept { labeller->mergeSeams(); }
+
+void MotionLabeller::collectBand(Band& band) noexcept {
+	for (uint32_t i = 0; i < band.usedCount; i++) { band.table[band.usedSlots[i]].root = emptySlot; }
+	band.usedCount = 0;
+	band.droppedCount = 0;
+
+	for (uint32_t y = band.top; y < band.bottom; y++) {
+		const uint8_t* row = mask + y * stride;
+		uint32_t lastCell = emptySlot;
+		uint32_t lastSlot = emptySlot;
+		for (uint32_t x = 0; x < width; x++) {
+			if (row[x] < maskThreshold) { continue; }
+			uint32_t cell = y * width + x;
+			// Cells of a run are all in the same component, so the root only has to be looked up for the first one.
+			uint32_t slot = lastSlot;
+			if (lastCell != cell - 1 || slot == emptySlot) { slot = findSlot(band.table, bandTableSize, band.usedSlots, band.usedCount, findRootReadOnly(parents, cell)); }
+			lastCell = cell;
+			lastSlot = slot;
+			if (slot == emptySlot) { band.droppedCount++; continue; }
+
+			ComponentStats& stats = band.table[slot];
+			stats.area++;
+			if (x < stats.left) { stats.left = x; }
+			if (x + 1 > stats.right) { stats.right = x + 1; }
+			if (y < stats.top) { stats.top = y; }
+			stats.bottom = y + 1;
+			stats.sumX += x;
+			stats.sumY += y;
+		}
+	}
+}
+
+void MotionLabeller::work(uint32_t bandIndex) noexcept {
+	while (true) {
+		startBarrier->arrive_and_wait();
+		if (stopping) { return; }
+		labelBand(bands[bandIndex]);
+		seamBarrier->arrive_and_wait();
+		collectBand(bands[bandIndex]);
+		endBarrier->arrive_and_wait();
+	}
+}
+
+// Returns the amount of components that got dropped because they didn't fit into the objects array.
+uint32_t MotionLabeller::mergeBands() noexcept {
+	// NOTE: mergeTable can take every band's table at full load (see mergeTableSize), so findSlot() can't fail here.
+	uint32_t mergeUsedCount = 0;
+	for (uint32_t i = 0; i < threadCount; i++) {
+		const Band& band = bands[i];
+		for (uint32_t j = 0; j < band.usedCount; j++) {
+			const ComponentStats& stats = band.table[band.usedSlots[j]];
+			uint32_t slot = findSlot(mergeTable, mergeTableSize, mergeUsedSlots, mergeUsedCount, stats.root);
+			ComponentStats& merged = mergeTable[slot];
+			merged.area += stats.area;
+			if (stats.left < merged.left) { merged.left = stats.left; }
+			if (stats.right > merged.right) { merged.right = stats.right; }
+			if (stats.top < merged.top) { merged.top = stats.top; }
+			if (stats.bottom > merged.bottom) { merged.bottom = stats.bottom; }
+			merged.sumX += stats.sumX;
+			merged.sumY += stats.sumY;
+		}
+	}
+
+	objectCount = 0;
+	uint32_t droppedCount = 0;
+	for (uint32_t i = 0; i < mergeUsedCount; i++) {
+		ComponentStats& merged = mergeTable[mergeUsedSlots[i]];
+		merged.root = emptySlot;
+		if (merged.area < minArea) { continue; }
+		if (objectCount == maxObjectCount) { droppedCount++; continue; }
+		objects[objectCount++] = { 0, merged.area, merged.left, merged.top, merged.right, merged.bottom,
+					   (float)merged.sumX / merged.area, (float)merged.sumY / merged.area, 0 };
+	}
+	return droppedCount;
+}
+
+// Greedy nearest-centroid association. Good enough for the handful of objects a security camera sees at once.
+void MotionLabeller::associate() noexcept {
+	bool taken[maxObjectCount] = { };
+	float maxDistanceSquared = maxAssociationDistance * maxAssociationDistance;
+	for (uint32_t i = 0; i < objectCount; i++) {
+		Object& object = objects[i];
+		uint32_t best = maxObjectCount;
+		float bestDistanceSquared = maxDistanceSquared;
+		for (uint32_t j = 0; j < previousObjectCount; j++) {
+			if (taken[j]) { continue; }
+			float dx = object.centroidX - previousObjects[j].centroidX;
+			float dy = object.centroidY - previousObjects[j].centroidY;
+			float distanceSquared = dx * dx + dy * dy;
+			if (distanceSquared <= bestDistanceSquared) { best = j; bestDistanceSquared = distanceSquared; }
+		}
+		if (best == maxObjectCount) { object.id = nextId++; object.age = 0; continue; }
+		taken[best] = true;
+		object.id = previousObjects[best].id;
+		object.age = previousObjects[best].age + 1;
+	}
+}
+
+MotionLabeller::Error MotionLabeller::label(const uint8_t* mask, size_t stride) {
+	auto start = std::chrono::steady_clock::now();
+
+	this->mask = mask;
+	this->stride = stride;
+	memcpy(previousObjects, objects, objectCount * sizeof(Object));
+	previousObjectCount = objectCount;
+
+	// The calling thread takes the last band. The barriers publish mask/stride to the workers and the results back to us.
+	Band& ownBand = bands[threadCount - 1];
+	startBarrier->arrive_and_wait();
+	labelBand(ownBand);
+	seamBarrier->arrive_and_wait();
+	collectBand(ownBand);
+	endBarrier->arrive_and_wait();
+
+	uint32_t droppedCount = 0;
+	for (uint32_t i = 0; i < threadCount; i++) { droppedCount += bands[i].droppedCount; }
+	droppedCount += mergeBands();
+	associate();
+
+	lastDuration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	if (droppedCount != 0) { return Error::object_limit_reached; }
+	if (timeBudget != 0 && lastDuration > timeBudget) { return Error::time_budget_exceeded; }
+	return Error::none;
+}
+
+MotionLabeller::Error MotionLabeller::free() {
+	if (!initialized) { return Error::already_freed; }
+	stopping = true;
+	startBarrier->arrive_and_wait();
+	for (uint32_t i = 0; i < threadCount - 1; i++) { workers[i].join(); }
+	startBarrier.reset();
+	seamBarrier.reset();
+	endBarrier.reset();
+	initialized = false;
+	return Error::none;
+}
+
+MotionLabeller::~MotionLabeller() { free(); }
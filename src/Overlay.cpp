@@ -0,0 +1,283 @@
+#include "../include/Overlay.h"
+#include "../include/Screen.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <sys/time.h>
+
+#include <linux/fb.h>
+
+using namespace vid;
+
+// Overlay::Error
+
+Overlay::Error::Error(Overlay::Error::ErrorValue value) noexcept : value(value) { }
+
+Overlay::Error::operator int() const noexcept { return value; }
+
+// Overlay
+
+// 5x7 font, one byte per row, the lowest 5 bits are the pixels (most significant of those is the leftmost pixel).
+// Indexed by character - firstGlyph. Characters that we don't need for status text are left empty.
+static const uint8_t font[Overlay::glyphCount][Overlay::glyphHeight] = {
+	{ 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b00000 },	// ' '
+	{ 0b00100, 0b00100, 0b00100, 0b00100, 0b00100, 0b00000, 0b00100 },	// '!'
+	{ }, { }, { },								// '"' '#' '$'
+	{ 0b11000, 0b11001, 0b00010, 0b00100, 0b01000, 0b10011, 0b00011 },	// '%'
+	{ }, { },								// '&' '''
+	{ 0b00010, 0b00100, 0b01000, 0b01000, 0b01000, 0b00100, 0b00010 },	// '('
+	{ 0b01000, 0b00100, 0b00010, 0b00010, 0b00010, 0b00100, 0b01000 },	// ')'
+	{ }, { },								// '*' '+'
+	{ 0b00000, 0b00000, 0b00000, 0b00000, 0b01100, 0b00100, 0b01000 },	// ','
+	{ 0b00000, 0b00000, 0b00000, 0b11111, 0b00000, 0b00000, 0b00000 },	// '-'
+	{ 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b01100, 0b01100 },	// '.'
+	{ 0b00000, 0b00001, 0b00010, 0b00100, 0b01000, 0b10000, 0b00000 },	// '/'
+	{ 0b01110, 0b10001, 0b10011, 0b10101, 0b11001, 0b10001, 0b01110 },	// '0'
+	{ 0b00100, 0b01100, 0b00100, 0b00100, 0b00100, 0b00100, 0b01110 },	// '1'
+	{ 0b01110, 0b10001, 0b00001, 0b00010, 0b00100, 0b01000, 0b11111 },	// '2'
+	{ 0b11111, 0b00010, 0b00100, 0b00010, 0b00001, 0b10001, 0b01110 },	// '3'
+	{ 0b00010, 0b00110, 0b01010, 0b10010, 0b11111, 0b00010, 0b00010 },	// '4'
+	{ 0b11111, 0b10000, 0b11110, 0b00001, 0b00001, 0b10001, 0b01110 },	// '5'
+	{ 0b00110, 0b01000, 0b10000, 0b11110, 0b10001, 0b10001, 0b01110 },	// '6'
+	{ 0b11111, 0b00001, 0b00010, 0b00100, 0b01000, 0b01000, 0b01000 },	// '7'
+	{ 0b01110, 0b10001, 0b10001, 0b01110, 0b10001, 0b10001, 0b01110 },	// '8'
+	{ 0b01110, 0b10001, 0b10001, 0b01111, 0b00001, 0b00010, 0b01100 },	// '9'
+	{ 0b00000, 0b01100, 0b01100, 0b00000, 0b01100, 0b01100, 0b00000 },	// ':'
+	{ }, { }, { }, { },							// ';' '<' '=' '>'
+	{ 0b01110, 0b10001, 0b00001, 0b00010, 0b00100, 0b00000, 0b00100 },	// '?'
+	{ },									// '@'
+	{ 0b01110, 0b10001, 0b10001, 0b10001, 0b11111, 0b10001, 0b10001 },	// 'A'
+	{ 0b11110, 0b10001, 0b10001, 0b11110, 0b10001, 0b10001, 0b11110 },	// 'B'
+	{ 0b01110, 0b10001, 0b10000, 0b10000, 0b10000, 0b10001, 0b01110 },	// 'C'
+	{ 0b11100, 0b10010, 0b10001, 0b10001, 0b10001, 0b10010, 0b11100 },	// 'D'
+	{ 0b11111, 0b10000, 0b10000, 0b11110, 0b10000, 0b10000, 0b11111 },	// 'E'
+	{ 0b11111, 0b10000, 0b10000, 0b11110, 0b10000, 0b10000, 0b10000 },	// 'F'
+	{ 0b01110, 0b10001, 0b10000, 0b10111, 0b10001, 0b10001, 0b01111 },	// 'G'
+	{ 0b10001, 0b10001, 0b10001, 0b11111, 0b10001, 0b10001, 0b10001 },	// 'H'
+	{ 0b01110, 0b00100, 0b00100, 0b00100, 0b00100, 0b00100, 0b01110 },	// 'I'
+	{ 0b00111, 0b00010, 0b00010, 0b00010, 0b00010, 0b10010, 0b01100 },	// 'J'
+	{ 0b10001, 0b10010, 0b10100, 0b11000, 0b10100, 0b10010, 0b10001 },	// 'K'
+	{ 0b10000, 0b10000, 0b10000, 0b10000, 0b10000, 0b10000, 0b11111 },	// 'L'
+	{ 0b10001, 0b11011, 0b10101, 0b10101, 0b10001, 0b10001, 0b10001 },	// 'M'
+	{ 0b10001, 0b10001, 0b11001, 0b10101, 0b10011, 0b10001, 0b10001 },	// 'N'
+	{ 0b01110, 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b01110 },	// 'O'
+	{ 0b11110, 0b10001, 0b10001, 0b11110, 0b10000, 0b10000, 0b10000 },	// 'P'
+	{ 0b01110, 0b10001, 0b10001, 0b10001, 0b10101, 0b10010, 0b01101 },	// 'Q'
+	{ 0b11110, 0b10001, 0b10001, 0b11110, 0b10100, 0b10010, 0b10001 },	// 'R'
+	{ 0b01111, 0b10000, 0b10000, 0b01110, 0b00001, 0b00001, 0b11110 },	// 'S'
+	{ 0b11111, 0b00100, 0b00100, 0b00100, 0b00100, 0b00100, 0b00100 },	// 'T'
+	{ 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b01110 },	// 'U'
+	{ 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b01010, 0b00100 },	// 'V'
+	{ 0b10001, 0b10001, 0b10001, 0b10101, 0b10101, 0b10101, 0b01010 },	// 'W'
+	{ 0b10001, 0b10001, 0b01010, 0b00100, 0b01010, 0b10001, 0b10001 },	// 'X'
+	{ 0b10001, 0b10001, 0b10001, 0b01010, 0b00100, 0b00100, 0b00100 },	// 'Y'
+	{ 0b11111, 0b00001, 0b00010, 0b00100, 0b01000, 0b10000, 0b11111 }	// 'Z'
+};
+
+// Packs one 8 bit channel into its place in a native pixel. Channels with less than 8 bits (RGB565 for example) just drop the low bits.
+static uint32_t packChannel(uint8_t value, uint8_t offset, uint8_t length) noexcept {
+	if (length == 0) { return 0; }
+	return ((uint32_t)value >> (8 - std::min<uint8_t>(length, 8))) << offset;
+}
+
+// Fills count pixels starting at destination with color. This is the only place where pixels actually get written.
+static void fillSpan(uint8_t* destination, uint32_t count, uint32_t color, uint32_t bytesPerPixel) noexcept {
+	if (bytesPerPixel == 4) { std::fill_n((uint32_t*)destination, count, color); return; }
+	std::fill_n((uint16_t*)destination, count, (uint16_t)color);
+}
+
+Overlay::Error Overlay::init(const Screen& screen, uint32_t textScale) {
+	if (initialized) { return Error::not_freed; }
+	if (!screen.initialized) { return Error::screen_not_initialized; }
+
+	const fb_var_screeninfo& info = screen.variableInfo;
+	if (info.bits_per_pixel != 32 && info.bits_per_pixel != 16) { return Error::pixel_format_unsupported; }
+
+	frame = (uint8_t*)screen.frame;
+	width = screen.width();
+	height = screen.height();
+	bytesPerPixel = info.bits_per_pixel / 8;
+	bytesPerLine = (size_t)width * bytesPerPixel;		// same layout that Screen::init() assumes when calculating frameSize
+
+	tilesPerRow = (width + tileSize - 1) / tileSize;
+	tilesPerColumn = (height + tileSize - 1) / tileSize;
+	if (tilesPerRow * tilesPerColumn > maxTileCount) { return Error::screen_too_large; }
+
+	redOffset = info.red.offset; redLength = info.red.length;
+	greenOffset = info.green.offset; greenLength = info.green.length;
+	blueOffset = info.blue.offset; blueLength = info.blue.length;
+	alphaOffset = info.transp.offset; alphaLength = info.transp.length;
+
+	if (textScale == 0) { textScale = 1; }
+	this->textScale = textScale;
+
+	// Rasterize the atlas. Every font row turns into at most 3 runs of set pixels, which get scaled horizontally here.
+	// Vertical scaling happens while drawing, by using the same GlyphRow for textScale screen rows.
+	for (uint32_t glyph = 0; glyph < glyphCount; glyph++) {
+		for (uint32_t row = 0; row < glyphHeight; row++) {
+			GlyphRow& glyphRow = glyphAtlas[glyph][row];
+			glyphRow.spanCount = 0;
+			uint8_t bits = font[glyph][row];
+			uint32_t column = 0;
+			while (column < glyphWidth) {
+				if (!(bits & (1 << (glyphWidth - 1 - column)))) { column++; continue; }
+				uint32_t start = column;
+				while (column < glyphWidth && (bits & (1 << (glyphWidth - 1 - column)))) { column++; }
+				glyphRow.spans[glyphRow.spanCount++] = { (uint16_t)(start * textScale), (uint16_t)((column - start) * textScale) };
+			}
+		}
+	}
+
+	primitiveCount = 0;
+	memset(touchedTiles, 0, sizeof(touchedTiles));
+	memset(previouslyTouchedTiles, 0, sizeof(previouslyTouchedTiles));
+
+	initialized = true;
+	return Error::none;
+}
+
+uint32_t Overlay::color(uint8_t red, uint8_t green, uint8_t blue) const noexcept {
+	return packChannel(red, redOffset, redLength) | packChannel(green, greenOffset, greenLength) | packChannel(blue, blueOffset, blueLength) | packChannel(255, alphaOffset, alphaLength);
+}
+
+void Overlay::beginFrame() noexcept {
+	memcpy(previouslyTouchedTiles, touchedTiles, sizeof(touchedTiles));
+	memset(touchedTiles, 0, sizeof(touchedTiles));
+	primitiveCount = 0;
+}
+
+// Clips the primitive to the screen and marks the tiles it covers. Returns false if nothing of it is visible, in which case it doesn't get added.
+static bool clipAndMark(Overlay& overlay, Overlay::Primitive& primitive, int32_t x, int32_t y, int32_t width, int32_t height) noexcept {
+	primitive.x = x; primitive.y = y;
+	primitive.left = std::max(x, 0);
+	primitive.top = std::max(y, 0);
+	primitive.right = (int32_t)std::min<int64_t>((int64_t)x + width, overlay.width);
+	primitive.bottom = (int32_t)std::min<int64_t>((int64_t)y + height, overlay.height);
+	if (primitive.left >= primitive.right || primitive.top >= primitive.bottom) { return false; }
+
+	for (uint32_t tileY = primitive.top / Overlay::tileSize; tileY <= (uint32_t)(primitive.bottom - 1) / Overlay::tileSize; tileY++) {
+		for (uint32_t tileX = primitive.left / Overlay::tileSize; tileX <= (uint32_t)(primitive.right - 1) / Overlay::tileSize; tileX++) {
+			uint32_t tile = tileY * overlay.tilesPerRow + tileX;
+			overlay.touchedTiles[tile / 64] |= (uint64_t)1 << (tile % 64);
+		}
+	}
+	return true;
+}
+
+Overlay::Error Overlay::addFilledRect(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t color) {
+	if (primitiveCount == maxPrimitiveCount) { return Error::too_many_primitives; }
+	Primitive& primitive = primitives[primitiveCount];
+	primitive.type = Primitive::fill;
+	primitive.color = color;
+	if (clipAndMark(*this, primitive, x, y, width, height)) { primitiveCount++; }
+	return Error::none;
+}
+
+Overlay::Error Overlay::addBox(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t thickness, uint32_t color) {
+	if (thickness * 2 >= (uint32_t)std::min(width, height)) { return addFilledRect(x, y, width, height, color); }
+	// NOTE: Each edge is its own fill so that the tiles in the middle of big boxes don't get touched.
+	if (maxPrimitiveCount - primitiveCount < 4) { return Error::too_many_primitives; }
+	addFilledRect(x, y, width, thickness, color);
+	addFilledRect(x, y + height - thickness, width, thickness, color);
+	addFilledRect(x, y + thickness, thickness, height - thickness * 2, color);
+	addFilledRect(x + width - thickness, y + thickness, thickness, height - thickness * 2, color);
+	return Error::none;
+}
+
+Overlay::Error Overlay::addText(int32_t x, int32_t y, const char* text, uint32_t color) {
+	if (primitiveCount == maxPrimitiveCount) { return Error::too_many_primitives; }
+	Primitive& primitive = primitives[primitiveCount];
+	primitive.type = Primitive::text;
+	primitive.color = color;
+
+	uint32_t length = 0;
+	for (; text[length] != '\0' && length < maxTextLength; length++) {
+		char character = text[length];
+		if (character >= 'a' && character <= 'z') { character -= 'a' - 'A'; }
+		if (character < firstGlyph || character > lastGlyph) { character = ' '; }
+		primitive.characters[length] = character - firstGlyph;		// store atlas indices, saves the subtraction while drawing
+	}
+	if (length == 0) { return Error::none; }
+	primitive.length = length;
+
+	if (clipAndMark(*this, primitive, x, y, (length * glyphAdvance - 1) * textScale, glyphHeight * textScale)) { primitiveCount++; }
+	return Error::none;
+}
+
+Overlay::Error Overlay::addFrameInfo(int32_t x, int32_t y, const timeval& timestamp, float framesPerSecond, uint32_t color) {
+	char text[maxTextLength];
+	tm brokenDownTime;
+	int64_t microseconds = (int64_t)timestamp.tv_sec * 1000000 + timestamp.tv_usec + timestampOffset;
+	time_t seconds = microseconds / 1000000;
+	localtime_r(&seconds, &brokenDownTime);
+	size_t length = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &brokenDownTime);
+	snprintf(text + length, sizeof(text) - length, "  %.1f FPS", framesPerSecond);
+	return addText(x, y, text, color);
+}
+
+void Overlay::composite() const noexcept {
+	for (uint32_t word = 0; word < (tilesPerRow * tilesPerColumn + 63) / 64; word++) {
+		uint64_t bits = touchedTiles[word];
+		while (bits) {
+			uint32_t tile = word * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+
+			int32_t tileLeft = (tile % tilesPerRow) * tileSize;
+			int32_t tileTop = (tile / tilesPerRow) * tileSize;
+			int32_t tileRight = std::min<int32_t>(tileLeft + tileSize, width);
+			int32_t tileBottom = std::min<int32_t>(tileTop + tileSize, height);
+
+			// Primitives get drawn in the order they were added, so later ones end up on top.
+			for (uint32_t i = 0; i < primitiveCount; i++) {
+				const Primitive& primitive = primitives[i];
+				int32_t left = std::max(primitive.left, tileLeft);
+				int32_t top = std::max(primitive.top, tileTop);
+				int32_t right = std::min(primitive.right, tileRight);
+				int32_t bottom = std::min(primitive.bottom, tileBottom);
+				if (left >= right || top >= bottom) { continue; }
+
+				if (primitive.type == Primitive::fill) {
+					for (int32_t y = top; y < bottom; y++) { fillSpan(frame + y * bytesPerLine + left * bytesPerPixel, right - left, primitive.color, bytesPerPixel); }
+					continue;
+				}
+
+				int32_t advance = glyphAdvance * textScale;
+				uint32_t firstCharacter = (left - primitive.x) / advance;
+				uint32_t endCharacter = std::min<uint32_t>((right - 1 - primitive.x) / advance + 1, primitive.length);
+				for (int32_t y = top; y < bottom; y++) {
+					uint32_t fontRow = (y - primitive.y) / textScale;
+					uint8_t* row = frame + y * bytesPerLine;
+					for (uint32_t character = firstCharacter; character < endCharacter; character++) {
+						const GlyphRow& glyphRow = glyphAtlas[(uint8_t)primitive.characters[character]][fontRow];
+						int32_t glyphX = primitive.x + character * advance;
+						for (uint32_t s = 0; s < glyphRow.spanCount; s++) {
+							int32_t spanLeft = std::max(glyphX + glyphRow.spans[s].start, left);
+							int32_t spanRight = std::min(glyphX + glyphRow.spans[s].start + glyphRow.spans[s].length, right);
+							if (spanLeft < spanRight) { fillSpan(row + spanLeft * bytesPerPixel, spanRight - spanLeft, primitive.color, bytesPerPixel); }
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+bool Overlay::isTileTouched(uint32_t tileX, uint32_t tileY) const noexcept {
+	uint32_t tile = tileY * tilesPerRow + tileX;
+	return touchedTiles[tile / 64] & ((uint64_t)1 << (tile % 64));
+}
+
+bool Overlay::wasTileTouched(uint32_t tileX, uint32_t tileY) const noexcept {
+	uint32_t tile = tileY * tilesPerRow + tileX;
+	return previouslyTouchedTiles[tile / 64] & ((uint64_t)1 << (tile % 64));
+}
+
+Overlay::Error Overlay::free() {
+	if (!initialized) { return Error::already_freed; }
+	initialized = false;
+	return Error::none;
+}
@@ -0,0 +1,247 @@
+#include "../include/RecordingStore.h"
+#include "../include/Camera.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linux/videodev2.h>
+
+using namespace vid;
+
+// RecordingStore::Error
+
+RecordingStore::Error::Error(RecordingStore::Error::ErrorValue value) noexcept : value(value) { }
+
+RecordingStore::Error::operator int() const noexcept { return value; }
+
+// RecordingStore
+
+static constexpr uint32_t indexMagic = 0x58444952;		// "RIDX"
+static constexpr uint32_t indexVersion = 1;
+
+// Reserves size bytes for the file up front. fallocate() is what we actually want, posix_fallocate() is only there for file systems that don't support it.
+static bool preallocate(int fd, uint64_t size) {
+	if (fallocate(fd, 0, 0, size) == 0) { return true; }
+	if (errno != EOPNOTSUPP) { return false; }
+	return posix_fallocate(fd, 0, size) == 0;
+}
+
+// Opens (or creates) an index file and maps it. A freshly created index gets its header filled in, an existing one has to have the same layout.
+static RecordingStore::Error openIndex(RecordingStore::MappedIndex& index, const char* path, const RecordingStore& store) {
+	index.fd = ::open(path, O_RDWR | O_CREAT, 0644);
+	if (index.fd == -1) { return RecordingStore::Error::index_open_failed; }
+
+	struct stat st;
+	if (fstat(index.fd, &st) == -1) { return RecordingStore::Error::index_open_failed; }
+	bool isNew = st.st_size == 0;
+
+	index.mappingSize = sizeof(RecordingStore::IndexHeader) + store.indexCapacity * sizeof(RecordingStore::IndexEntry);
+	if (isNew && !preallocate(index.fd, index.mappingSize)) { return RecordingStore::Error::index_allocation_failed; }
+	if (!isNew && (uint64_t)st.st_size != index.mappingSize) { return RecordingStore::Error::index_layout_mismatch; }
+
+	void* mapping = mmap(nullptr, index.mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, index.fd, 0);
+	if (mapping == MAP_FAILED) { return RecordingStore::Error::mmap_failed; }
+	index.header = (RecordingStore::IndexHeader*)mapping;
+	index.entries = (RecordingStore::IndexEntry*)(index.header + 1);
+
+	RecordingStore::IndexHeader& header = *index.header;
+	if (isNew) {
+		header.magic = indexMagic;
+		header.version = indexVersion;
+		header.segmentCount = store.segmentCount;
+		header.segmentSize = store.segmentSize;
+		header.capacity = store.indexCapacity;
+		header.firstEntry = 0;
+		header.endEntry = 0;
+		header.writeSegment = 0;
+		header.writeOffset = 0;
+		return RecordingStore::Error::none;
+	}
+	if (header.magic != indexMagic || header.version != indexVersion || header.segmentCount != store.segmentCount ||
+	    header.segmentSize != store.segmentSize || header.capacity != store.indexCapacity) { return RecordingStore::Error::index_layout_mismatch; }
+	return RecordingStore::Error::none;
+}
+
+static RecordingStore::Error closeIndex(RecordingStore::MappedIndex& index) {
+	RecordingStore::Error err = RecordingStore::Error::none;
+	if (index.header) {
+		if (munmap(index.header, index.mappingSize) == -1) { err = RecordingStore::Error::munmap_failed; }
+		index.header = nullptr;
+	}
+	if (index.fd != -1) {
+		if (::close(index.fd) == -1 && err == RecordingStore::Error::none) { err = RecordingStore::Error::file_close_failed; }
+		index.fd = -1;
+	}
+	return err;
+}
+
+static RecordingStore::IndexEntry& entryAt(const RecordingStore::MappedIndex& index, uint64_t position) { return index.entries[position % index.header->capacity]; }
+
+// Appends an entry. If the ring is full, the oldest entry gets dropped to make room.
+// NOTE: The entry is written before endEntry is published, so a reader mapping the same file never sees a half written entry.
+static void appendEntry(RecordingStore::MappedIndex& index, const RecordingStore::IndexEntry& entry) {
+	RecordingStore::IndexHeader& header = *index.header;
+	if (header.endEntry - header.firstEntry == header.capacity) { header.firstEntry++; }
+	entryAt(index, header.endEntry) = entry;
+	__atomic_store_n(&header.endEntry, header.endEntry + 1, __ATOMIC_RELEASE);
+}
+
+// Drops all entries at the front of the index that point into segment. Entries are in write order and segments are reused in ring order,
+// so the entries of the segment that is about to be overwritten are always the oldest ones.
+static void dropSegmentEntries(RecordingStore::MappedIndex& index, uint32_t segment) {
+	RecordingStore::IndexHeader& header = *index.header;
+	while (header.firstEntry != header.endEntry && entryAt(index, header.firstEntry).segment == segment) { header.firstEntry++; }
+}
+
+// Returns the position of the first entry with a timestamp >= timestamp, or endEntry if there isn't one.
+static uint64_t lowerBound(const RecordingStore::MappedIndex& index, uint64_t timestamp) {
+	uint64_t low = index.header->firstEntry;
+	uint64_t high = __atomic_load_n(&index.header->endEntry, __ATOMIC_ACQUIRE);
+	while (low < high) {
+		uint64_t middle = low + (high - low) / 2;
+		if (entryAt(index, middle).timestamp < timestamp) { low = middle + 1; }
+		else { high = middle; }
+	}
+	return low;
+}
+
+RecordingStore::RecordingStore(const char* directory) noexcept : directory(directory), segmentCount(0) { }
+
+RecordingStore::Error RecordingStore::open(uint32_t segmentCount, uint64_t segmentSize, uint64_t indexCapacity) {
+	if (frameIndex.fd != -1) { return Error::not_closed; }
+	if (segmentCount == 0 || segmentCount > maxSegmentCount || segmentSize == 0 || indexCapacity == 0) { return Error::invalid_layout; }
+
+	this->segmentCount = segmentCount;
+	this->segmentSize = segmentSize;
+	this->indexCapacity = indexCapacity;
+	for (uint32_t i = 0; i < segmentCount; i++) { segmentFds[i] = -1; }
+
+	char path[4096];
+	Error err = Error::none;
+
+	snprintf(path, sizeof(path), "%s/frames.idx", directory);
+	err = openIndex(frameIndex, path, *this); if (err != Error::none) { goto closeAndReturnError; }
+	snprintf(path, sizeof(path), "%s/events.idx", directory);
+	err = openIndex(eventIndex, path, *this); if (err != Error::none) { goto closeAndReturnError; }
+
+	for (uint32_t i = 0; i < segmentCount; i++) {
+		snprintf(path, sizeof(path), "%s/segment_%03u.bin", directory, i);
+		segmentFds[i] = ::open(path, O_RDWR | O_CREAT, 0644);
+		if (segmentFds[i] == -1) { err = Error::segment_open_failed; goto closeAndReturnError; }
+		struct stat st;
+		if (fstat(segmentFds[i], &st) == -1) { err = Error::segment_open_failed; goto closeAndReturnError; }
+		if ((uint64_t)st.st_size != segmentSize && !preallocate(segmentFds[i], segmentSize)) { err = Error::segment_allocation_failed; goto closeAndReturnError; }
+	}
+
+	return Error::none;
+
+closeAndReturnError:
+	close();
+	return err;
+}
+
+RecordingStore::Error RecordingStore::appendFrame(const v4l2_buffer& buffer, const void* data) {
+	if (buffer.bytesused > segmentSize) { return Error::frame_too_large; }
+
+	IndexHeader& header = *frameIndex.header;
+	uint64_t timestamp = (uint64_t)((int64_t)buffer.timestamp.tv_sec * 1000000 + buffer.timestamp.tv_usec + timestampOffset);
+	if (header.endEntry != header.firstEntry && timestamp < entryAt(frameIndex, header.endEntry - 1).timestamp) { return Error::timestamp_out_of_order; }
+
+	if (header.writeOffset + buffer.bytesused > segmentSize) {
+		header.writeSegment = (header.writeSegment + 1) % segmentCount;
+		header.writeOffset = 0;
+		dropSegmentEntries(frameIndex, header.writeSegment);
+		dropSegmentEntries(eventIndex, header.writeSegment);
+	}
+
+	const uint8_t* source = (const uint8_t*)data;
+	size_t written = 0;
+	while (written < buffer.bytesused) {
+		ssize_t result = pwrite(segmentFds[header.writeSegment], source + written, buffer.bytesused - written, header.writeOffset + written);
+		if (result == -1) { if (errno == EINTR) { continue; } return Error::segment_write_failed; }
+		written += result;
+	}
+
+	appendEntry(frameIndex, { timestamp, header.writeOffset, buffer.bytesused, header.writeSegment, buffer.sequence, EntryType::frame });
+	header.writeOffset += buffer.bytesused;
+	return Error::none;
+}
+
+RecordingStore::Error RecordingStore::appendFrame(const Camera& camera) { return appendFrame(camera.bufferData, camera.frameLocations[camera.bufferData.index].start); }
+
+RecordingStore::Error RecordingStore::appendEvent(uint64_t timestamp, uint32_t type) {
+	const IndexHeader& header = *frameIndex.header;
+	if (eventIndex.header->endEntry != eventIndex.header->firstEntry && timestamp < entryAt(eventIndex, eventIndex.header->endEntry - 1).timestamp) { return Error::timestamp_out_of_order; }
+
+	IndexEntry event = { timestamp, header.writeOffset, 0, header.writeSegment, 0, type };
+	if (header.endEntry != header.firstEntry) {
+		const IndexEntry& lastFrame = entryAt(frameIndex, header.endEntry - 1);
+		event.offset = lastFrame.offset;
+		event.segment = lastFrame.segment;
+		event.sequence = lastFrame.sequence;
+	}
+	appendEntry(eventIndex, event);
+	return Error::none;
+}
+
+RecordingStore::Error RecordingStore::seek(uint64_t timestamp, IndexEntry& entry) const {
+	uint64_t position = lowerBound(frameIndex, timestamp);
+	if (position == frameIndex.header->endEntry) { return Error::not_found; }
+	entry = entryAt(frameIndex, position);
+	return Error::none;
+}
+
+RecordingStore::Error RecordingStore::findEvents(uint64_t begin, uint64_t end, IndexEntry* events, size_t capacity, size_t& count) const {
+	count = 0;
+	uint64_t endEntry = __atomic_load_n(&eventIndex.header->endEntry, __ATOMIC_ACQUIRE);
+	for (uint64_t position = lowerBound(eventIndex, begin); position < endEntry && count < capacity; position++) {
+		const IndexEntry& event = entryAt(eventIndex, position);
+		if (event.timestamp >= end) { break; }
+		events[count++] = event;
+	}
+	return Error::none;
+}
+
+RecordingStore::Error RecordingStore::readFrame(const IndexEntry& entry, void* destination) const {
+	if (entry.segment >= segmentCount || entry.offset + entry.size > segmentSize) { return Error::segment_read_failed; }
+	uint8_t* target = (uint8_t*)destination;
+	size_t alreadyRead = 0;
+	while (alreadyRead < entry.size) {
+		ssize_t result = pread(segmentFds[entry.segment], target + alreadyRead, entry.size - alreadyRead, entry.offset + alreadyRead);
+		if (result == -1) { if (errno == EINTR) { continue; } return Error::segment_read_failed; }
+		if (result == 0) { return Error::segment_read_failed; }
+		alreadyRead += result;
+	}
+	return Error::none;
+}
+
+RecordingStore::Error RecordingStore::sync() {
+	if (msync(frameIndex.header, frameIndex.mappingSize, MS_SYNC) == -1) { return Error::msync_failed; }
+	if (msync(eventIndex.header, eventIndex.mappingSize, MS_SYNC) == -1) { return Error::msync_failed; }
+	return Error::none;
+}
+
+RecordingStore::Error RecordingStore::close() {
+	if (frameIndex.fd == -1) { return Error::already_closed; }
+
+	// NOTE: Keep going on errors so that nothing gets leaked, return the first one at the end.
+	Error err = Error::none;
+	if (frameIndex.header && eventIndex.header) { err = sync(); }
+	Error indexErr = closeIndex(frameIndex); if (err == Error::none) { err = indexErr; }
+	indexErr = closeIndex(eventIndex); if (err == Error::none) { err = indexErr; }
+
+	for (uint32_t i = 0; i < segmentCount; i++) {
+		if (segmentFds[i] == -1) { continue; }
+		if (::close(segmentFds[i]) == -1 && err == Error::none) { err = Error::file_close_failed; }
+		segmentFds[i] = -1;
+	}
+	return err;
+}
+
+RecordingStore::~RecordingStore() { close(); }
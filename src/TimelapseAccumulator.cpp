@@ -0,0 +1,175 @@
+#include "../include/TimelapseAccumulator.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <linux/videodev2.h>
+
+using namespace vid;
+
+// TimelapseAccumulator::Error
+
+TimelapseAccumulator::Error::Error(TimelapseAccumulator::Error::ErrorValue value) noexcept : value(value) { }
+
+TimelapseAccumulator::Error::operator int() const noexcept { return value; }
+
+// TimelapseAccumulator
+
+// Returns the bytes per filtered unit for the pixel format, or 0 if it isn't supported.
+static uint32_t unitSize(uint32_t pixelFormat) noexcept {
+	switch (pixelFormat) {
+	case V4L2_PIX_FMT_RGB24: case V4L2_PIX_FMT_BGR24: return 3;
+	case V4L2_PIX_FMT_GREY: return 1;
+	case V4L2_PIX_FMT_YUYV: return 4;
+	default: return 0;
+	}
+}
+
+static size_t alignUp(size_t size) noexcept { return (size + 63) & ~(size_t)63; }
+
+// Adds count bytes of source to the 16 bit sums. This is the part that touches every input byte, so it's the part that's vectorized.
+static void addRow(uint16_t* sums, const uint8_t* source, size_t count) noexcept {
+	size_t i = 0;
+#if defined(__ARM_NEON)
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t bytes = vld1q_u8(source + i);
+		vst1q_u16(sums + i, vaddw_u8(vld1q_u16(sums + i), vget_low_u8(bytes)));
+		vst1q_u16(sums + i + 8, vaddw_u8(vld1q_u16(sums + i + 8), vget_high_u8(bytes)));
+	}
+#elif defined(__SSE2__)
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(source + i));
+		__m128i* low = (__m128i*)(sums + i);
+		__m128i* high = (__m128i*)(sums + i + 8);
+		_mm_storeu_si128(low, _mm_add_epi16(_mm_loadu_si128(low), _mm_unpacklo_epi8(bytes, zero)));
+		_mm_storeu_si128(high, _mm_add_epi16(_mm_loadu_si128(high), _mm_unpackhi_epi8(bytes, zero)));
+	}
+#endif
+	for (; i < count; i++) { sums[i] += source[i]; }
+}
+
+// Sums up the boxes of one row of column sums and writes their averages. Templated on the channel count so that the per-channel sums stay in registers.
+// NOTE: The sums of one box fit into 32 bits (maxFactor^2 * 255), and multiplying by the reciprocal brings that back down to 8 bits,
+// so the multiply stays 32 bits too. Can be off by one compared to a real division, which doesn't matter for thumbnails.
+template <uint32_t channels>
+static void reduceRow(const uint16_t* columnSums, uint8_t* outputRow, uint32_t* sumRow, size_t outputBytesPerLine, uint32_t horizontalFactor, uint32_t boxReciprocal) noexcept {
+	const uint16_t* box = columnSums;
+	for (size_t outputX = 0; outputX < outputBytesPerLine; outputX += channels) {
+		uint32_t sums[channels] = { };
+		for (uint32_t i = 0; i < horizontalFactor; i++, box += channels) {
+			for (uint32_t channel = 0; channel < channels; channel++) { sums[channel] += box[channel]; }
+		}
+		for (uint32_t channel = 0; channel < channels; channel++) {
+			uint32_t average = (sums[channel] * boxReciprocal + (1 << 15)) >> 16;
+			if (average > 255) { average = 255; }
+			outputRow[outputX + channel] = average;
+			sumRow[outputX + channel] += average;
+		}
+	}
+}
+
+size_t TimelapseAccumulator::requiredSize(const v4l2_format& format, uint32_t factor, uint32_t thumbnailCapacity) noexcept {
+	const v4l2_pix_format& pix = format.fmt.pix;
+	uint32_t channels = unitSize(pix.pixelformat);
+	if (channels == 0 || factor == 0 || factor > maxFactor) { return 0; }
+	if (channels == 4 && factor % 2 != 0) { return 0; }
+	uint32_t inputUnits = channels == 4 ? pix.width / 2 : pix.width;
+	uint32_t horizontalFactor = channels == 4 ? factor / 2 : factor;
+	size_t outputSize = (size_t)(inputUnits / horizontalFactor) * channels * (pix.height / factor);
+	if (outputSize == 0) { return 0; }
+	return alignUp(outputSize * sizeof(uint32_t)) + alignUp((size_t)inputUnits * channels * sizeof(uint16_t)) + alignUp(outputSize) * (2 + thumbnailCapacity);
+}
+
+TimelapseAccumulator::Error TimelapseAccumulator::init(const v4l2_format& format, uint32_t factor, uint32_t framesPerTimelapseFrame, uint32_t thumbnailCapacity, void* memory) {
+	if (initialized) { return Error::not_freed; }
+	const v4l2_pix_format& pix = format.fmt.pix;
+	channels = unitSize(pix.pixelformat);
+	if (channels == 0) { return Error::format_unsupported; }
+	if (factor == 0 || factor > maxFactor || (channels == 4 && factor % 2 != 0)) { return Error::invalid_factor; }
+	if (framesPerTimelapseFrame == 0 || framesPerTimelapseFrame > maxFramesPerTimelapseFrame) { return Error::invalid_interval; }
+	if (requiredSize(format, factor, thumbnailCapacity) == 0) { return Error::invalid_factor; }		// frame is smaller than one box
+
+	this->factor = factor;
+	horizontalFactor = channels == 4 ? factor / 2 : factor;
+	inputUnits = channels == 4 ? pix.width / 2 : pix.width;
+	uint32_t outputUnits = inputUnits / horizontalFactor;
+	outputWidth = channels == 4 ? outputUnits * 2 : outputUnits;
+	outputHeight = pix.height / factor;
+	outputBytesPerLine = (size_t)outputUnits * channels;
+	outputSize = outputBytesPerLine * outputHeight;
+
+	this->framesPerTimelapseFrame = framesPerTimelapseFrame;
+	this->thumbnailCapacity = thumbnailCapacity;
+	boxReciprocal = ((1 << 16) + factor * horizontalFactor / 2) / (factor * horizontalFactor);
+	timelapseReciprocal = (((uint64_t)1 << 32) + framesPerTimelapseFrame / 2) / framesPerTimelapseFrame;
+
+	uint8_t* next = (uint8_t*)memory;
+	timelapseSums = (uint32_t*)next; next += alignUp(outputSize * sizeof(uint32_t));
+	columnSums = (uint16_t*)next; next += alignUp((size_t)inputUnits * channels * sizeof(uint16_t));
+	current = next; next += alignUp(outputSize);
+	timelapseFrame = next; next += alignUp(outputSize);
+	thumbnails = next;
+
+	memset(timelapseSums, 0, outputSize * sizeof(uint32_t));
+	accumulatedFrameCount = 0;
+	timelapseFrameCount = 0;
+	timelapseFrameReady = false;
+	thumbnailCount = 0;
+
+	initialized = true;
+	return Error::none;
+}
+
+void TimelapseAccumulator::push(const void* frame, uint32_t bytesPerLine) noexcept {
+	const uint8_t* input = (const uint8_t*)frame;
+	size_t rowBytes = (size_t)inputUnits * channels;
+
+	for (uint32_t outputY = 0; outputY < outputHeight; outputY++) {
+		memset(columnSums, 0, rowBytes * sizeof(uint16_t));
+		for (uint32_t row = 0; row < factor; row++) { addRow(columnSums, input + (size_t)(outputY * factor + row) * bytesPerLine, rowBytes); }
+
+		uint8_t* outputRow = current + outputY * outputBytesPerLine;
+		uint32_t* sumRow = timelapseSums + outputY * outputBytesPerLine;
+		switch (channels) {
+		case 1: reduceRow<1>(columnSums, outputRow, sumRow, outputBytesPerLine, horizontalFactor, boxReciprocal); break;
+		case 3: reduceRow<3>(columnSums, outputRow, sumRow, outputBytesPerLine, horizontalFactor, boxReciprocal); break;
+		case 4: reduceRow<4>(columnSums, outputRow, sumRow, outputBytesPerLine, horizontalFactor, boxReciprocal); break;
+		}
+	}
+
+	timelapseFrameReady = false;
+	if (++accumulatedFrameCount != framesPerTimelapseFrame) { return; }
+
+	for (size_t i = 0; i < outputSize; i++) {
+		timelapseFrame[i] = (timelapseSums[i] * timelapseReciprocal + ((uint64_t)1 << 31)) >> 32;
+		timelapseSums[i] = 0;
+	}
+	accumulatedFrameCount = 0;
+	timelapseFrameCount++;
+	timelapseFrameReady = true;
+}
+
+void TimelapseAccumulator::beginEvent() noexcept { thumbnailCount = 0; }
+
+TimelapseAccumulator::Error TimelapseAccumulator::captureThumbnail() noexcept {
+	if (thumbnailCount == thumbnailCapacity) { return Error::thumbnail_strip_full; }
+	memcpy(thumbnails + alignUp(outputSize) * thumbnailCount, current, outputSize);
+	thumbnailCount++;
+	return Error::none;
+}
+
+const uint8_t* TimelapseAccumulator::thumbnail(uint32_t index) const noexcept { return thumbnails + alignUp(outputSize) * index; }
+
+TimelapseAccumulator::Error TimelapseAccumulator::free() {
+	if (!initialized) { return Error::already_freed; }
+	initialized = false;
+	return Error::none;
+}
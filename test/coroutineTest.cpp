@@ -0,0 +1,65 @@
+#include <iostream>
+#include <chrono>
+#include <ratio>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+#include "../include/Camera.h"
+#include "../include/Executor.h"
+
+#include <linux/videodev2.h>
+
+using namespace vid;
+
+std::atomic<uint64_t> checksum = 0;
+std::atomic<uint32_t> runningStages = 0;
+
+// A capture stage written as a straight line. It hands every other frame to a second stage, which picks it up on whichever worker is free.
+Task analyze(FrameLease frame, Executor& executor) {
+	co_await executor.resumeOnWorker();
+	const uint8_t* data = (const uint8_t*)frame.data;
+	uint64_t sum = 0;
+	for (uint32_t i = 0; i < frame.bytesused; i += 64) { sum += data[i]; }
+	checksum += sum;
+}								// frame gets requeued here
+
+Task capture(Camera& camera, Executor& executor, unsigned int frameCount) {
+	co_await executor.resumeOnWorker();
+	for (unsigned int i = 0; i < frameCount; i++) {
+		FrameLease frame = co_await camera.nextFrame(executor);
+		if (!frame) { std::cout << "nextFrame() failed with error code: " << frame.error << std::endl; break; }
+		if (i % 2 == 0) { analyze(std::move(frame), executor); }
+	}
+	std::cout << "capture stage finished on thread " << std::this_thread::get_id() << std::endl;
+	if (--runningStages == 0) { executor.stop(); }
+}
+
+int main() {
+	std::cout << "starting coroutine test..." << std::endl;
+	std::cout << "press enter to capture 100 frames from /dev/video0 through the executor" << std::endl;
+	std::cin.get();
+
+	Camera camera("/dev/video0");
+	Camera::Error err = camera.open();
+	if (err != Camera::Error::none) { std::cout << "open() failed with error code: " << err << std::endl; return 0; }
+	camera.bufferMetadata.count = 4;
+	err = camera.defaultInit();
+	if (err != Camera::Error::none) { std::cout << "defaultInit() failed with error code: " << err << std::endl; return 0; }
+	if (camera.queueAllFrames() != Camera::Error::none) { std::cout << "had issues queueing frames" << std::endl; return 0; }
+	if (camera.start()) { std::cout << "had issues starting stream" << std::endl; return 0; }
+
+	Executor executor;
+	Executor::Error executorErr = executor.init(2);
+	if (executorErr != Executor::Error::none) { std::cout << "executor init() failed with error code: " << executorErr << std::endl; return 0; }
+
+	auto start = std::chrono::high_resolution_clock::now();
+	runningStages = 1;
+	capture(camera, executor, 100);
+	executorErr = executor.run();
+	std::chrono::duration<double, std::ratio<1>> duration = std::chrono::high_resolution_clock::now() - start;
+	if (executorErr != Executor::Error::none) { std::cout << "run() failed with error code: " << executorErr << std::endl; }
+	executor.free();
+
+	std::cout << "captured 100 frames in " << duration.count() << " seconds, checksum " << checksum << std::endl;
+}
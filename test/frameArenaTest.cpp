@@ -0,0 +1,48 @@
+#include <iostream>
+#include <cstring>
+
+#include "../include/FrameArena.h"
+
+#include <linux/videodev2.h>
+
+using namespace vid;
+
+// Doesn't need a camera, uses a made up 640x480 YUYV format.
+int main() {
+	std::cout << "starting frame arena test..." << std::endl;
+
+	v4l2_format format;
+	memset(&format, 0, sizeof(format));
+	format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	format.fmt.pix.width = 640;
+	format.fmt.pix.height = 480;
+	format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+	format.fmt.pix.bytesperline = 640 * 2;
+	format.fmt.pix.sizeimage = 640 * 480 * 2;
+
+	FrameArena arena;
+	FrameArena::FormatLayout layout;
+	FrameArena::Error err = arena.planFormat(format, 30, layout);
+	if (err != FrameArena::Error::none) { std::cout << "planFormat() failed with error code: " << err << std::endl; return 0; }
+	arena.reserveScratch(1024 * 1024);
+	std::cout << "required size: " << arena.requiredSize() / 1024 << " KiB" << std::endl;
+
+	err = arena.init(1024 * 1024);
+	if (err == FrameArena::Error::budget_exceeded) { std::cout << "init() with a 1 MiB budget was rejected, as it should be" << std::endl; }
+	else { std::cout << "init() with a 1 MiB budget didn't fail with budget_exceeded, err: " << err << std::endl; }
+
+	err = arena.init(64 * 1024 * 1024);
+	if (err != FrameArena::Error::none) { std::cout << "init() with a 64 MiB budget failed with error code: " << err << std::endl; return 0; }
+
+	for (int frame = 0; frame < 100; frame++) {
+		memset(arena.get(layout.currentLuma), frame, layout.width * layout.height);
+		void* rowSums = arena.allocateScratch(layout.height * sizeof(uint32_t));
+		void* histogram = arena.allocateScratch(256 * sizeof(uint32_t));
+		if (!rowSums || !histogram) { std::cout << "scratch allocation failed in frame " << frame << std::endl; }
+		arena.resetScratch();
+	}
+	std::cout << "peak usage: " << arena.peakUsage() / 1024 << " KiB, failed scratch allocations: " << arena.failedScratchAllocations << std::endl;
+
+	if (arena.free() != FrameArena::Error::none) { std::cout << "problem while freeing arena" << std::endl; }
+	else { std::cout << "freed arena fine, quitting..." << std::endl; }
+}
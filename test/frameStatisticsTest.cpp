@@ -0,0 +1,73 @@
+#include <iostream>
+#include <chrono>
+#include <ratio>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+
+#include "../include/FrameStatistics.h"
+
+#include <linux/videodev2.h>
+
+using namespace vid;
+
+#define WIDTH 1280
+#define HEIGHT 720
+
+static uint8_t frame[WIDTH * HEIGHT * 2];
+
+// Plain pass over the frame that does as little as possible, this is what the statistics get compared against.
+uint64_t sweep(const uint8_t* data, size_t size) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < size; i++) { sum += data[i]; }
+	return sum;
+}
+
+// Doesn't need a camera. Fills a fake YUYV frame with a gradient plus noise, checks the results and compares the cost to a plain memory sweep.
+int main() {
+	std::cout << "starting frame statistics test..." << std::endl;
+
+	v4l2_format format;
+	memset(&format, 0, sizeof(format));
+	format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	format.fmt.pix.width = WIDTH;
+	format.fmt.pix.height = HEIGHT;
+	format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+	format.fmt.pix.bytesperline = WIDTH * 2;
+	format.fmt.pix.sizeimage = sizeof(frame);
+
+	// luma is a horizontal gradient with +-2 of noise, the right 20% are blown out to 255
+	for (int y = 0; y < HEIGHT; y++) {
+		for (int x = 0; x < WIDTH; x++) {
+			int luma = x >= WIDTH * 4 / 5 ? 255 : 20 + x * 200 / WIDTH + rand() % 5 - 2;
+			frame[(y * WIDTH + x) * 2] = luma;
+			frame[(y * WIDTH + x) * 2 + 1] = 128;
+		}
+	}
+
+	static FrameStatistics statistics;		// NOTE: static because the tile arrays make it too big to be comfortable on the stack
+	FrameStatistics::Error err = statistics.init(format);
+	if (err != FrameStatistics::Error::none) { std::cout << "init() failed with error code: " << err << std::endl; return 0; }
+
+	double statisticsMicroseconds = 0;
+	double sweepMicroseconds = 0;
+	uint64_t checksum = 0;
+	for (int i = 0; i < 100; i++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		statistics.compute(frame, format.fmt.pix.bytesperline);
+		auto middle = std::chrono::high_resolution_clock::now();
+		checksum += sweep(frame, sizeof(frame));
+		auto end = std::chrono::high_resolution_clock::now();
+		statisticsMicroseconds += std::chrono::duration<double, std::micro>(middle - start).count();
+		sweepMicroseconds += std::chrono::duration<double, std::micro>(end - middle).count();
+	}
+
+	std::cout << "mean: " << statistics.mean << ", variance: " << statistics.variance << std::endl;
+	std::cout << "high clipped pixels: " << statistics.highClippedCount << " (expected " << WIDTH / 5 * HEIGHT << ")" << std::endl;
+	std::cout << "exposure: " << (statistics.exposure == FrameStatistics::Exposure::overexposed ? "overexposed (expected)" : "not overexposed (wrong)") << std::endl;
+	std::cout << "noise estimate: " << statistics.noiseEstimate << ", suggested threshold: " << (int)statistics.suggestedThreshold << std::endl;
+	std::cout << "average compute() time: " << statisticsMicroseconds / 100 << " microseconds, plain sweep: " << sweepMicroseconds / 100 << " microseconds (checksum " << checksum << ")" << std::endl;
+
+	statistics.free();
+	std::cout << "quitting..." << std::endl;
+}
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+
+#include "../include/MotionLabeller.h"
+
+using namespace vid;
+
+#define WIDTH 640
+#define HEIGHT 480
+
+static uint8_t mask[WIDTH * HEIGHT];
+
+void drawBlob(int left, int top, int width, int height) {
+	for (int y = top; y < top + height; y++) { memset(mask + y * WIDTH + left, 255, width); }
+}
+
+// Doesn't need a camera. Moves two blobs across a fake 640x480 mask (one of them straddles the band seams), sprinkles some noise in and
+// checks that the blobs keep their IDs and that the noise gets filtered out.
+int main() {
+	std::cout << "starting motion labeller test..." << std::endl;
+
+	static uint32_t memory[WIDTH * HEIGHT];
+	static MotionLabeller labeller;			// NOTE: static because the per-band tables make it too big to be comfortable on the stack
+	MotionLabeller::Error err = labeller.init(WIDTH, HEIGHT, 4, memory);
+	if (err != MotionLabeller::Error::none) { std::cout << "init() failed with error code: " << err << std::endl; return 0; }
+
+	uint32_t totalDuration = 0;
+	uint32_t maxDuration = 0;
+	for (int frame = 0; frame < 100; frame++) {
+		memset(mask, 0, sizeof(mask));
+		drawBlob(10 + frame * 2, 50, 40, 30);
+		drawBlob(300 - frame, 100, 60, 300);		// tall enough to go through every band
+		for (int i = 0; i < 200; i++) { mask[rand() % (WIDTH * HEIGHT)] = 255; }
+
+		err = labeller.label(mask, WIDTH);
+		if (err != MotionLabeller::Error::none) { std::cout << "label() returned error code " << err << " in frame " << frame << std::endl; }
+		totalDuration += labeller.lastDuration;
+		if (labeller.lastDuration > maxDuration) { maxDuration = labeller.lastDuration; }
+
+		if (frame % 25 == 0 || frame == 99) {
+			std::cout << "frame " << frame << ": " << labeller.objectCount << " objects (expected 2)" << std::endl;
+			for (uint32_t i = 0; i < labeller.objectCount; i++) {
+				const MotionLabeller::Object& object = labeller.objects[i];
+				std::cout << "	id " << object.id << ", area " << object.area << ", box " << object.left << "," << object.top << " - " << object.right << "," << object.bottom
+					  << ", centroid " << object.centroidX << "," << object.centroidY << ", age " << object.age << std::endl;
+			}
+		}
+	}
+	std::cout << "average label() time: " << totalDuration / 100 << " microseconds, max: " << maxDuration << " microseconds" << std::endl;
+
+	if (labeller.free() != MotionLabeller::Error::none) { std::cout << "problem while freeing labeller" << std::endl; }
+	else { std::cout << "freed labeller fine, quitting..." << std::endl; }
+}
@@ -0,0 +1,97 @@
+#include "../include/Screen.h"
+#include "../include/Overlay.h"
+
+#include <signal.h>
+#include <iostream>
+#include <chrono>
+#include <ratio>
+#include <cstring>
+#include <ctime>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+
+bool isAlive = true;
+
+void signalHandler(int signum) { isAlive = false; }
+
+int main() {
+	signal(SIGINT, signalHandler);
+	std::cout << "testing overlay" << std::endl;
+	vid::Screen screen;
+	vid::Screen::Error err = screen.open();
+	if (err != vid::Screen::Error::none) {
+		std::cout << "error encountered while opening screen, err: " << err << std::endl;
+		return 0;
+	}
+	err = screen.init();
+	if (err != vid::Screen::Error::none) {
+		std::cout << "error encountered while initializing screen, err: " << err << std::endl;
+		return 0;
+	}
+	memset(screen.frame, 0, screen.frameSize);
+
+	vid::Overlay overlay;
+	vid::Overlay::Error overlayErr = overlay.init(screen, 3);
+	if (overlayErr != vid::Overlay::Error::none) {
+		std::cout << "error encountered while initializing overlay, err: " << overlayErr << std::endl;
+		return 0;
+	}
+	uint32_t white = overlay.color(255, 255, 255);
+
+	timespec realtime, monotonic;
+	clock_gettime(CLOCK_REALTIME, &realtime);
+	clock_gettime(CLOCK_MONOTONIC, &monotonic);
+	overlay.timestampOffset = (int64_t)(realtime.tv_sec - monotonic.tv_sec) * 1000000 + (realtime.tv_nsec - monotonic.tv_nsec) / 1000;
+	uint32_t red = overlay.color(255, 0, 0);
+	uint32_t green = overlay.color(0, 255, 0);
+
+	// Moves a fake motion box across the screen and measures how long compositing takes.
+	int32_t boxX = 0;
+	double totalMicroseconds = 0;
+	unsigned int frameCount = 0;
+	while (isAlive) {
+		overlay.beginFrame();
+		// Same clock as camera timestamps, so this goes through timestampOffset like the real thing would.
+		timespec monotonic;
+		clock_gettime(CLOCK_MONOTONIC, &monotonic);
+		timeval now = { monotonic.tv_sec, monotonic.tv_nsec / 1000 };
+		overlay.addFrameInfo(20, 20, now, 30, white);
+		overlay.addBox(100, 100, 400, 300, 2, green);
+		overlay.addBox(boxX, 200, 120, 80, 3, red);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		// Erase the tiles that the last frame drew in. In the real thing, this is where the camera image would get redrawn.
+		for (uint32_t tileY = 0; tileY < overlay.tilesPerColumn; tileY++) {
+			for (uint32_t tileX = 0; tileX < overlay.tilesPerRow; tileX++) {
+				if (!overlay.wasTileTouched(tileX, tileY)) { continue; }
+				uint32_t tileBottom = std::min((tileY + 1) * vid::Overlay::tileSize, overlay.height);
+				uint32_t tileWidth = std::min(vid::Overlay::tileSize, overlay.width - tileX * vid::Overlay::tileSize);
+				for (uint32_t y = tileY * vid::Overlay::tileSize; y < tileBottom; y++) {
+					memset(overlay.frame + y * overlay.bytesPerLine + tileX * vid::Overlay::tileSize * overlay.bytesPerPixel, 0, tileWidth * overlay.bytesPerPixel);
+				}
+			}
+		}
+		overlay.composite();
+		std::chrono::duration<double, std::micro> duration = std::chrono::high_resolution_clock::now() - start;
+		totalMicroseconds += duration.count();
+		frameCount++;
+
+		boxX = (boxX + 4) % screen.width();
+		usleep(33000);
+	}
+	std::cout << "average erase + composite time: " << totalMicroseconds / frameCount << " microseconds" << std::endl;
+
+	std::cout << "exiting test..." << std::endl;
+	overlay.free();
+	err = screen.free();
+	if (err != vid::Screen::Error::none) {
+		std::cout << "error encountered while freeing screen, err: " << err << std::endl;
+		return 0;
+	}
+	err = screen.close();
+	if (err != vid::Screen::Error::none) {
+		std::cout << "error encountered while closing screen, err: " << err << std::endl;
+		return 0;
+	}
+}
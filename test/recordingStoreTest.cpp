@@ -0,0 +1,71 @@
+#include <iostream>
+#include <chrono>
+#include <ratio>
+#include <cstring>
+#include <cstdint>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/RecordingStore.h"
+
+#include <linux/videodev2.h>
+
+using namespace vid;
+
+// Doesn't need a camera. Writes fake frames into a small store so that the ring wraps a couple of times, then checks seeking and event queries.
+int main() {
+	std::cout << "starting recording store test..." << std::endl;
+	mkdir("recordingStoreTest", 0755);
+	// start from scratch, otherwise the timestamps of the last run would be newer than the ones we write
+	unlink("recordingStoreTest/frames.idx");
+	unlink("recordingStoreTest/events.idx");
+
+	RecordingStore store("recordingStoreTest");
+	RecordingStore::Error err = store.open(4, 1024 * 1024, 4096);
+	if (err != RecordingStore::Error::none) { std::cout << "open() failed with error code: " << err << std::endl; return 0; }
+
+	static uint8_t frame[100 * 1024];
+	v4l2_buffer buffer;
+	memset(&buffer, 0, sizeof(buffer));
+	buffer.bytesused = sizeof(frame);
+
+	// 100 frames of 100KiB at 10 FPS into 4 segments of 1MiB. Each segment holds 10 frames, so only the last 40 frames survive.
+	uint64_t firstTimestamp = 0;
+	for (uint32_t i = 0; i < 100; i++) {
+		memset(frame, i, sizeof(frame));
+		buffer.sequence = i;
+		buffer.timestamp.tv_sec = 1000 + i / 10;
+		buffer.timestamp.tv_usec = (i % 10) * 100000;
+		if (i == 0) { firstTimestamp = (uint64_t)buffer.timestamp.tv_sec * 1000000; }
+		if (err = store.appendFrame(buffer, frame)) { std::cout << "appendFrame() failed with error code: " << err << std::endl; return 0; }
+		if (i % 25 == 0) { store.appendEvent((uint64_t)buffer.timestamp.tv_sec * 1000000 + buffer.timestamp.tv_usec, RecordingStore::EntryType::motion_start); }
+	}
+
+	RecordingStore::IndexEntry entry;
+	err = store.seek(firstTimestamp, entry);
+	if (err != RecordingStore::Error::none) { std::cout << "seek() to the start failed with error code: " << err << std::endl; }
+	else { std::cout << "oldest surviving frame has sequence " << entry.sequence << " (expected 60)" << std::endl; }
+
+	err = store.seek(firstTimestamp + 9500000, entry);
+	if (err != RecordingStore::Error::none) { std::cout << "seek() failed with error code: " << err << std::endl; }
+	else {
+		std::cout << "seeked to frame with sequence " << entry.sequence << " (expected 95)" << std::endl;
+		if (store.readFrame(entry, frame) != RecordingStore::Error::none || frame[0] != 95 || frame[sizeof(frame) - 1] != 95) { std::cout << "read back wrong frame data" << std::endl; }
+		else { std::cout << "frame data is correct" << std::endl; }
+	}
+
+	RecordingStore::IndexEntry events[8];
+	size_t eventCount;
+	store.findEvents(0, UINT64_MAX, events, 8, eventCount);
+	std::cout << "found " << eventCount << " surviving events (expected 1, sequence 75)";
+	if (eventCount != 0) { std::cout << ", first one has sequence " << events[0].sequence; }
+	std::cout << std::endl;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < 100000; i++) { store.seek(firstTimestamp + (i % 100) * 100000, entry); }
+	std::chrono::duration<double, std::nano> duration = std::chrono::high_resolution_clock::now() - start;
+	std::cout << "average seek time: " << duration.count() / 100000 << " nanoseconds" << std::endl;
+
+	if (store.close() != RecordingStore::Error::none) { std::cout << "problem while closing store" << std::endl; }
+	else { std::cout << "closed store fine, quitting..." << std::endl; }
+}
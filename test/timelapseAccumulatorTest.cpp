@@ -0,0 +1,61 @@
+#include <iostream>
+#include <chrono>
+#include <ratio>
+#include <cstring>
+#include <cstdint>
+
+#include "../include/FrameArena.h"
+#include "../include/TimelapseAccumulator.h"
+
+#include <linux/videodev2.h>
+
+using namespace vid;
+
+// Doesn't need a camera. Pushes fake 1280x720 RGB24 frames through the accumulator and checks the averages it produces.
+int main() {
+	std::cout << "starting timelapse accumulator test..." << std::endl;
+
+	v4l2_format format;
+	memset(&format, 0, sizeof(format));
+	format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	format.fmt.pix.width = 1280;
+	format.fmt.pix.height = 720;
+	format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
+	format.fmt.pix.bytesperline = 1280 * 3;
+	format.fmt.pix.sizeimage = 1280 * 720 * 3;
+
+	FrameArena arena;
+	uint32_t frameHandle, accumulatorHandle;
+	arena.plan("fake frame", format.fmt.pix.sizeimage, frameHandle);
+	arena.plan("timelapse accumulator", TimelapseAccumulator::requiredSize(format, 8, 16), accumulatorHandle);
+	FrameArena::Error arenaErr = arena.init();
+	if (arenaErr != FrameArena::Error::none) { std::cout << "arena init() failed with error code: " << arenaErr << std::endl; return 0; }
+
+	TimelapseAccumulator accumulator;
+	TimelapseAccumulator::Error err = accumulator.init(format, 8, 10, 16, arena.get(accumulatorHandle));
+	if (err != TimelapseAccumulator::Error::none) { std::cout << "init() failed with error code: " << err << std::endl; return 0; }
+	std::cout << "output size: " << accumulator.outputWidth << "x" << accumulator.outputHeight << " (expected 160x90)" << std::endl;
+
+	// Every frame is one flat color, frame i has the value i * 10, so the first timelapse frame should be (0 + 10 + ... + 90) / 10 = 45.
+	uint8_t* frame = (uint8_t*)arena.get(frameHandle);
+	double totalMicroseconds = 0;
+	for (int i = 0; i < 100; i++) {
+		memset(frame, (i % 10) * 10, format.fmt.pix.sizeimage);
+		auto start = std::chrono::high_resolution_clock::now();
+		accumulator.push(frame, format.fmt.pix.bytesperline);
+		std::chrono::duration<double, std::micro> duration = std::chrono::high_resolution_clock::now() - start;
+		totalMicroseconds += duration.count();
+		if (i == 5) { accumulator.captureThumbnail(); }
+		if (i == 9) {
+			if (!accumulator.timelapseFrameReady) { std::cout << "timelapse frame wasn't ready after 10 frames" << std::endl; }
+			std::cout << "first timelapse pixel: " << (int)accumulator.timelapseFrame[0] << " (expected 45), last: " << (int)accumulator.timelapseFrame[accumulator.outputSize - 1] << std::endl;
+		}
+	}
+	std::cout << "timelapse frames: " << accumulator.timelapseFrameCount << " (expected 10)" << std::endl;
+	std::cout << "thumbnails: " << accumulator.thumbnailCount << " (expected 1), value: " << (int)accumulator.thumbnail(0)[0] << " (expected 50)" << std::endl;
+	std::cout << "average push() time: " << totalMicroseconds / 100 << " microseconds" << std::endl;
+
+	accumulator.free();
+	arena.free();
+	std::cout << "quitting..." << std::endl;
+}
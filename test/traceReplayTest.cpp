@@ -0,0 +1,73 @@
+#include <iostream>
+#include <chrono>
+#include <ratio>
+#include <cstdint>
+
+#include "../include/Camera.h"
+#include "../include/CaptureTrace.h"
+
+#include <linux/videodev2.h>
+
+using namespace vid;
+
+// Stand-in for a processing stage. Written against the shared Camera/ReplayCamera interface, so it runs on both.
+template <typename CameraType>
+typename CameraType::Error processFrames(CameraType& camera, unsigned int frameCount, uint64_t& checksum) {
+	typename CameraType::Error err = camera.queueAllFrames(); if (err != CameraType::Error::none) { return err; }
+	for (unsigned int i = 0; i < frameCount; i++) {
+		err = camera.dequeueFrame(); if (err != CameraType::Error::none) { return err; }
+		const uint8_t* frame = (const uint8_t*)camera.frameLocations[camera.bufferData.index].start;
+		for (uint32_t j = 0; j < camera.bufferData.bytesused; j += 64) { checksum += frame[j]; }
+		err = camera.queueFrame(); if (err != CameraType::Error::none) { return err; }
+	}
+	return CameraType::Error::none;
+}
+
+int main() {
+	std::cout << "starting trace replay test..." << std::endl;
+	std::cout << "press enter to record 50 frames from /dev/video0 into trace.bin" << std::endl;
+	std::cin.get();
+
+	uint64_t recordedChecksum = 0;
+	{
+		Camera camera("/dev/video0");
+		Camera::Error err = camera.open();
+		if (err != Camera::Error::none) { std::cout << "open() failed with error code: " << err << std::endl; return 0; }
+		camera.bufferMetadata.count = 4;
+		err = camera.defaultInit();
+		if (err != Camera::Error::none) { std::cout << "defaultInit() failed with error code: " << err << std::endl; return 0; }
+
+		TraceRecorder recorder;
+		TraceRecorder::Error recorderErr = recorder.open("trace.bin", camera.format, camera.bufferMetadata.count);
+		if (recorderErr != TraceRecorder::Error::none) { std::cout << "recorder open() failed with error code: " << recorderErr << std::endl; return 0; }
+		camera.traceRecorder = &recorder;
+
+		if (camera.start()) { std::cout << "had issues starting stream" << std::endl; return 0; }
+		err = processFrames(camera, 50, recordedChecksum);
+		if (err != Camera::Error::none) { std::cout << "processing live frames failed with error code: " << err << std::endl; }
+		camera.traceRecorder = nullptr;
+		if (recorder.close() != TraceRecorder::Error::none) { std::cout << "problem while closing recorder" << std::endl; }
+		std::cout << "recorded " << recorder.header.frameCount << " frames" << std::endl;
+	}
+
+	std::cout << "press enter to replay the trace, once with original timing and once as fast as possible" << std::endl;
+	std::cin.get();
+
+	for (int pass = 0; pass < 2; pass++) {
+		ReplayCamera replay("trace.bin");
+		replay.realTime = pass == 0;
+		replay.preload = pass == 1;
+		ReplayCamera::Error err = replay.open();
+		if (err != ReplayCamera::Error::none) { std::cout << "replay open() failed with error code: " << err << std::endl; return 0; }
+		err = replay.init();
+		if (err != ReplayCamera::Error::none) { std::cout << "replay init() failed with error code: " << err << std::endl; return 0; }
+		replay.start();
+
+		uint64_t replayedChecksum = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		err = processFrames(replay, 50, replayedChecksum);
+		std::chrono::duration<double, std::ratio<1>> duration = std::chrono::high_resolution_clock::now() - start;
+		if (err != ReplayCamera::Error::none) { std::cout << "replay failed with error code: " << err << std::endl; }
+		std::cout << (pass == 0 ? "real time" : "fast") << " replay took " << duration.count() << " seconds, checksum " << (replayedChecksum == recordedChecksum ? "matches" : "doesn't match") << std::endl;
+	}
+}